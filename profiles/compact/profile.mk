@@ -1,7 +1,15 @@
 USE_FLAGS ?= -DUSE_STRICT_IEEE_754=1 \
              -DUSE_COMPUTED_GOTO=0 \
              -DUSE_BYTECODE_OPTIMISER=0 \
-             -DUSE_THREADED_COMPILER=0
+             -DUSE_THREADED_COMPILER=0 \
+             -DUSE_REGISTER_OPS=0 \
+             -DUSE_FUSED_OPS=0 \
+             -DUSE_JIT=0 \
+             -DUSE_SUPERINSTRUCTIONS=0 \
+             -DUSE_DIRECT_THREADING=0 \
+             -DUSE_TOS_CACHE=0 \
+             -DUSE_TYPED_OPS=0 \
+             -DUSE_OPCODE_PROFILE=0
 
 COMPILER_FLAGS += -Os
 
@@ -1,7 +1,15 @@
 USE_FLAGS ?= -DUSE_STRICT_IEEE_754=1 \
              -DUSE_COMPUTED_GOTO=1 \
              -DUSE_BYTECODE_OPTIMISER=1 \
-             -DUSE_THREADED_COMPILER=1
+             -DUSE_THREADED_COMPILER=1 \
+             -DUSE_REGISTER_OPS=1 \
+             -DUSE_FUSED_OPS=1 \
+             -DUSE_JIT=1 \
+             -DUSE_SUPERINSTRUCTIONS=1 \
+             -DUSE_DIRECT_THREADING=1 \
+             -DUSE_TOS_CACHE=1 \
+             -DUSE_TYPED_OPS=1 \
+             -DUSE_OPCODE_PROFILE=0
 
 COMPILER_FLAGS += -O3
 
@@ -10,10 +10,13 @@
 #define GUARD_DWT_CLASS_OBJ_HPP
 
 #include <dwt/function_obj.hpp>
+#include <dwt/hash_map.hpp>
 #include <dwt/string_obj.hpp>
 
 namespace dwt {
 
+class shape;
+
 class class_obj : public function_obj {
 public:
   class_obj(size_t arity, string_obj *name);
@@ -25,6 +28,15 @@ public:
   virtual obj *clone() override;
   virtual void blacken() override;
   virtual std::string to_string() override;
+
+  shape *layout();
+
+  void add_method(string_obj *name, function_obj *fn);
+  var method(var key) const;
+
+private:
+  shape *_layout = nullptr;
+  hash_map _methods;
 };
 
 } // namespace dwt
@@ -19,6 +19,61 @@
 
 namespace dwt {
 
+class shape;
+
+/**
+ * Per call site cache of the most recently seen instance layout and the
+ * slot offset that the member resolved to within it. If the member is a
+ * method of the instance's class then the method itself is cached instead.
+ */
+struct member_cache {
+  shape *layout = nullptr;
+  size_t slot = 0;
+  var method = nil;
+};
+
+// number of receiver layouts remembered by a polymorphic call site
+#define INVOKE_CACHE_WAYS 4
+
+/**
+ * Per call site cache for method invocations. Up to INVOKE_CACHE_WAYS
+ * receiver layouts are remembered, after which the oldest entry is
+ * replaced.
+ */
+struct invoke_cache {
+  member_cache ways[INVOKE_CACHE_WAYS];
+  size_t next = 0;
+
+  inline member_cache *find(shape *layout) {
+    for (auto &way : ways) {
+      if (way.layout == layout) {
+        return &way;
+      }
+    }
+
+    return nullptr;
+  }
+
+  inline member_cache &replace() {
+    auto &way = ways[next];
+    next = (next + 1) % INVOKE_CACHE_WAYS;
+    return way;
+  }
+};
+
+enum call_kind { CALL_FUNCTION, CALL_CLOSURE, CALL_SYSCALL };
+
+/**
+ * Per call site cache of the most recently called object, which has already
+ * been checked to accept the number of arguments passed at the call site.
+ * The callee is not kept alive by the cache, the entry is dropped when the
+ * callee is collected.
+ */
+struct call_cache {
+  var callee = nil;
+  call_kind kind = CALL_FUNCTION;
+};
+
 class code_obj : public obj {
 public:
   code_obj();
@@ -62,14 +117,54 @@ public:
     return _bytes;
   }
 
+  // the most values the code pushes on top of the arguments of its frame
+  size_t max_stack() const {
+    return _max_stack;
+  }
+
+  void max_stack(size_t max_stack) {
+    _max_stack = max_stack;
+  }
+
+  // the pre-decoded form the interpreter runs, empty until the first call
+  std::vector<uint64_t> &threaded() {
+    return _threaded;
+  }
+
   void emit(uint8_t, token_ref ref = token_ref());
   void token_at(size_t, token_ref);
   token_ref token_at(size_t);
   void unmap_token_at(size_t idx);
 
+  uint16_t add_member_cache();
+
+  inline member_cache &member_cache_at(size_t idx) {
+    return _member_caches[idx];
+  }
+
+  uint16_t add_call_cache();
+
+  inline call_cache &call_cache_at(size_t idx) {
+    return _call_caches[idx];
+  }
+
+  uint16_t add_invoke_cache();
+
+  inline invoke_cache &invoke_cache_at(size_t idx) {
+    return _invoke_caches[idx];
+  }
+
+  void sweep_callees();
+  void sweep_layouts();
+
 private:
   std::vector<uint8_t> _bytes;
+  std::vector<uint64_t> _threaded;
   std::vector<token_ref> _tokens;
+  std::vector<member_cache> _member_caches;
+  std::vector<call_cache> _call_caches;
+  std::vector<invoke_cache> _invoke_caches;
+  size_t _max_stack = 0;
 };
 
 } // namespace dwt
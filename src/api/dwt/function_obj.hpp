@@ -85,6 +85,18 @@ public:
     return _is_api;
   }
 
+  void *jit_code() const {
+    return _jit_code;
+  }
+
+  void jit_code(void *code) {
+    _jit_code = code;
+  }
+
+  unsigned int &hotness() {
+    return _hotness;
+  }
+
 private:
   function_type _type;
   size_t _arity;
@@ -99,6 +111,8 @@ protected:
 private:
   size_t _patchpoint = 0;
   bool _is_api = false;
+  void *_jit_code = nullptr;
+  unsigned int _hotness = 0;
 };
 
 } // namespace dwt
@@ -13,6 +13,7 @@
 #include <dwt/closure_obj.hpp>
 #include <dwt/map_obj.hpp>
 #include <dwt/obj.hpp>
+#include <dwt/shape.hpp>
 
 #include <vector>
 
@@ -35,17 +36,30 @@ public:
     op_keyset(OBJ_AS_VAR(str), v);
   }
 
+  shape *layout() const {
+    return _shape;
+  }
+
+  inline var &slot_at(size_t idx) {
+    return _slots[idx];
+  }
+
   virtual obj_type type() override;
   virtual obj *clone() override;
   virtual void blacken() override;
   virtual void call(interpreter &, int) override;
   virtual std::string to_string() override;
+  virtual size_t length() override;
   virtual var op_mbrget(var) override;
   virtual void op_mbrset(var, var) override;
+  virtual var op_keyget(var) override;
+  virtual void op_keyset(var, var) override;
 
 private:
   instance_obj *_super;
   class_obj *_klass;
+  shape *_shape;
+  std::vector<var> _slots;
 };
 
 } // namespace dwt
@@ -30,6 +30,7 @@
 #define VAR_AS_NUM(v) var_as_num(v)
 #define VAR_AS_INT(v) var_as_int(v)
 #define VAR_IS_NUM(v) (((v) &QNAN) != QNAN)
+#define VARS_ARE_NUM(v0, v1) (VAR_IS_NUM(v0) & VAR_IS_NUM(v1))
 #define TAG_NIL (1ull)
 #define TAG_FALSE (2ull)
 #define TAG_TRUE (3ull)
@@ -136,6 +137,14 @@ var obj_var_mul(var v0, var v1);
 var obj_var_div(var v0, var v1);
 var obj_var_neg(var v0);
 
+inline bool num_var_eq(var v0, var v1) {
+#if USE_STRICT_IEEE_754
+  return VAR_AS_NUM(v0) == VAR_AS_NUM(v1);
+#else
+  return v0 == v1;
+#endif
+}
+
 inline bool var_eq(var v0, var v1) {
 #if USE_STRICT_IEEE_754
   if (VAR_IS_NUM(v0) && VAR_IS_NUM(v1)) {
@@ -308,6 +317,98 @@ inline var var_neg(var v0) {
   throw interpret_exception("e@1 invalid operand");
 }
 
+// numbers stay doubles, the integer operators take those with no fraction
+// that fit in 64 bits and work on them as integers
+inline bool var_is_int(var v0, int64_t &i) {
+  if (VAR_IS_NUM(v0)) {
+    double d = VAR_AS_NUM(v0);
+    if (d >= -0x1p63 && d < 0x1p63) {
+      i = static_cast<int64_t>(d);
+      return static_cast<double>(i) == d;
+    }
+  }
+
+  return false;
+}
+
+inline var int_as_var(int64_t i) {
+  return NUM_AS_VAR(static_cast<double>(i));
+}
+
+inline var var_mod(var v0, var v1) {
+  int64_t i0, i1;
+
+  if (var_is_int(v0, i0) && var_is_int(v1, i1) && i1 != 0) {
+    return int_as_var(i1 == -1 ? 0 : i0 % i1);
+  }
+
+  if (VAR_IS_NUM(v0) && VAR_IS_NUM(v1)) {
+    return NUM_AS_VAR(fmod(VAR_AS_NUM(v0), VAR_AS_NUM(v1)));
+  }
+
+  throw interpret_exception("e@1 invalid operands");
+}
+
+inline var var_shl(var v0, var v1) {
+  int64_t i0, i1;
+
+  if (var_is_int(v0, i0) && var_is_int(v1, i1) && i1 >= 0 && i1 < 64) {
+    return int_as_var(static_cast<int64_t>(static_cast<uint64_t>(i0) << i1));
+  }
+
+  throw interpret_exception("e@1 invalid operands");
+}
+
+inline var var_shr(var v0, var v1) {
+  int64_t i0, i1;
+
+  if (var_is_int(v0, i0) && var_is_int(v1, i1) && i1 >= 0 && i1 < 64) {
+    return int_as_var(i0 >> i1);
+  }
+
+  throw interpret_exception("e@1 invalid operands");
+}
+
+inline var var_band(var v0, var v1) {
+  int64_t i0, i1;
+
+  if (var_is_int(v0, i0) && var_is_int(v1, i1)) {
+    return int_as_var(i0 & i1);
+  }
+
+  throw interpret_exception("e@1 invalid operands");
+}
+
+inline var var_bor(var v0, var v1) {
+  int64_t i0, i1;
+
+  if (var_is_int(v0, i0) && var_is_int(v1, i1)) {
+    return int_as_var(i0 | i1);
+  }
+
+  throw interpret_exception("e@1 invalid operands");
+}
+
+inline var var_bxor(var v0, var v1) {
+  int64_t i0, i1;
+
+  if (var_is_int(v0, i0) && var_is_int(v1, i1)) {
+    return int_as_var(i0 ^ i1);
+  }
+
+  throw interpret_exception("e@1 invalid operands");
+}
+
+inline var var_bnot(var v0) {
+  int64_t i0;
+
+  if (var_is_int(v0, i0)) {
+    return int_as_var(~i0);
+  }
+
+  throw interpret_exception("e@1 invalid operand");
+}
+
 } // namespace dwt
 
 #endif
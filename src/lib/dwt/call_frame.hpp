@@ -15,6 +15,7 @@
 #include <dwt/instance_obj.hpp>
 #include <dwt/mapfn_obj.hpp>
 #include <dwt/obj.hpp>
+#include <dwt/threaded_code.hpp>
 
 namespace dwt {
 
@@ -22,7 +23,7 @@ class call_frame {
 public:
   inline call_frame(function_obj *fn, unsigned int sp)
     : fn(fn)
-    , ip(fn->code().entry())
+    , ip(threaded_code::entry(fn))
     , sp(sp)
     , closure(nullptr)
     , map(nullptr) {
@@ -30,17 +31,25 @@ public:
 
   inline call_frame(closure_obj *closure, unsigned int sp)
     : fn(closure->fun_obj())
-    , ip(fn->code().entry())
+    , ip(threaded_code::entry(fn))
     , sp(sp)
     , closure(closure)
-    , map((fn->type() == OBJ_CLASS) || (fn->type() == OBJ_MAPINI)
+    , map(fn->type() == OBJ_CLASS
             ? new instance_obj(static_cast<class_obj *>(fn))
-            : nullptr) {
+            : (fn->type() == OBJ_MAPINI ? new map_obj : nullptr)) {
+  }
+
+  inline call_frame(function_obj *fn, closure_obj *closure, unsigned int sp)
+    : fn(fn)
+    , ip(threaded_code::entry(fn))
+    , sp(sp)
+    , closure(closure)
+    , map(nullptr) {
   }
 
   inline call_frame(class_obj *klass, unsigned int sp)
     : fn(klass)
-    , ip(fn->code().entry())
+    , ip(threaded_code::entry(fn))
     , sp(sp)
     , closure(nullptr)
     , map(new instance_obj(klass)) {
@@ -48,7 +57,7 @@ public:
 
   inline call_frame(mapfn_obj *mapfn, unsigned int sp)
     : fn(mapfn)
-    , ip(fn->code().entry())
+    , ip(threaded_code::entry(fn))
     , sp(sp)
     , closure(nullptr)
     , map(new map_obj) {
@@ -66,7 +75,7 @@ public:
   }
 
   function_obj *fn;
-  uint8_t *ip;
+  code_unit *ip;
   unsigned int sp;
   closure_obj *closure;
   map_obj *map;
@@ -8,6 +8,7 @@
 
 #include <dwt/class_obj.hpp>
 #include <dwt/interpreter.hpp>
+#include <dwt/shape.hpp>
 #include <dwt/string_obj.hpp>
 #include <dwt/var.hpp>
 
@@ -19,9 +20,21 @@ class_obj::class_obj(size_t arity, string_obj *name)
 
 class_obj::class_obj(const class_obj &other)
   : function_obj(other) {
+
+  // methods carry no per-instance state so they are shared, not cloned
+  other._methods.for_all([this](auto entry) { _methods.add(*entry); });
+
+  // as are the layouts, instances of either class are built the same way
+  if (other._layout) {
+    _layout = other._layout;
+    _layout->acquire();
+  }
 }
 
 class_obj::~class_obj() {
+  if (_layout) {
+    _layout->release();
+  }
 }
 
 obj_type class_obj::type() {
@@ -34,6 +47,11 @@ obj *class_obj::clone() {
 
 void class_obj::blacken() {
   function_obj::blacken();
+
+  _methods.for_all([](auto entry) {
+    VAR_AS_OBJ(entry->key)->mark_as(MARK_GREY);
+    VAR_AS_OBJ(entry->value)->mark_as(MARK_GREY);
+  });
 }
 
 void class_obj::call(interpreter &interpreter, int nr_args) {
@@ -44,4 +62,46 @@ std::string class_obj::to_string() {
   return "<obj " + name() + ">";
 }
 
+/**
+ * Get the root shape shared by all instances of this class and its clones.
+ *
+ * @return The root shape.
+ */
+shape *class_obj::layout() {
+  if (!_layout) {
+    _layout = shape::make_root();
+    _layout->acquire();
+  }
+
+  return _layout;
+}
+
+/**
+ * Add a method to the method table shared by all instances of this class.
+ * Only methods that capture no upvars can be shared in this way, anything
+ * else is bound to each instance as a closure.
+ *
+ * @param name The method name.
+ * @param fn The method.
+ */
+void class_obj::add_method(string_obj *name, function_obj *fn) {
+  _methods.add(kv_pair(OBJ_AS_VAR(name), OBJ_AS_VAR(fn)));
+}
+
+/**
+ * Look up a method in the method table of this class.
+ *
+ * @param key The method name.
+ * @return The method, or nil if this class has no such method.
+ */
+var class_obj::method(var key) const {
+  auto kv = _methods.get(key);
+
+  if (kv) {
+    return kv->value;
+  }
+
+  return nil;
+}
+
 } // namespace dwt
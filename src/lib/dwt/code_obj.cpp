@@ -7,6 +7,7 @@
 // Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
 
 #include <dwt/code_obj.hpp>
+#include <dwt/shape.hpp>
 
 namespace dwt {
 
@@ -18,7 +19,11 @@ code_obj::~code_obj() {
 
 code_obj::code_obj(const code_obj &other)
   : _bytes(other._bytes)
-  , _tokens(other._tokens) {
+  , _tokens(other._tokens)
+  , _member_caches(other._member_caches)
+  , _call_caches(other._call_caches)
+  , _invoke_caches(other._invoke_caches)
+  , _max_stack(other._max_stack) {
 }
 
 obj_type code_obj::type() {
@@ -53,4 +58,54 @@ void code_obj::unmap_token_at(size_t idx) {
   _tokens[idx] = token_ref();
 }
 
+uint16_t code_obj::add_member_cache() {
+  _member_caches.emplace_back();
+  return _member_caches.size() - 1;
+}
+
+uint16_t code_obj::add_call_cache() {
+  _call_caches.emplace_back();
+  return _call_caches.size() - 1;
+}
+
+uint16_t code_obj::add_invoke_cache() {
+  _invoke_caches.emplace_back();
+  return _invoke_caches.size() - 1;
+}
+
+/**
+ * Drop the call site caches of callees that are about to be collected, so
+ * that an object later allocated at the same address is not mistaken for
+ * one. Called by the garbage collector after marking and before any object
+ * is freed.
+ */
+void code_obj::sweep_callees() {
+  for (auto &cache : _call_caches) {
+    if (VAR_IS_OBJ(cache.callee) &&
+        VAR_AS_OBJ(cache.callee)->marked_as() != MARK_GREY) {
+      cache = call_cache();
+    }
+  }
+}
+
+/**
+ * Drop the member and invoke caches of layouts that have been retired,
+ * before they are freed.
+ */
+void code_obj::sweep_layouts() {
+  for (auto &cache : _member_caches) {
+    if (cache.layout && cache.layout->is_retired()) {
+      cache = member_cache();
+    }
+  }
+
+  for (auto &cache : _invoke_caches) {
+    for (auto &way : cache.ways) {
+      if (way.layout && way.layout->is_retired()) {
+        way = member_cache();
+      }
+    }
+  }
+}
+
 } // namespace dwt
@@ -18,6 +18,7 @@
 #include <dwt/ir/and_expr.hpp>
 #include <dwt/ir/arguments.hpp>
 #include <dwt/ir/assign_expr.hpp>
+#include <dwt/ir/bitwise_expr.hpp>
 #include <dwt/ir/block.hpp>
 #include <dwt/ir/boolean.hpp>
 #include <dwt/ir/break_stmt.hpp>
@@ -53,6 +54,7 @@
 #include <dwt/ir/return_stmt.hpp>
 #include <dwt/ir/scoped_name.hpp>
 #include <dwt/ir/script.hpp>
+#include <dwt/ir/shift_expr.hpp>
 #include <dwt/ir/string_spec.hpp>
 #include <dwt/ir/subscript_expr.hpp>
 #include <dwt/ir/super_expr.hpp>
@@ -69,6 +71,7 @@
 #include <dwt/mapfn_obj.hpp>
 #include <dwt/opcode.hpp>
 #include <dwt/reporting.hpp>
+#include <dwt/stack_depth.hpp>
 #include <dwt/string_mgr.hpp>
 #include <dwt/var.hpp>
 
@@ -79,6 +82,16 @@
 #include <dwt/init_reload_pass.hpp>
 #include <dwt/popn_pass.hpp>
 #include <dwt/tco_pass.hpp>
+#if USE_FUSED_OPS
+#include <dwt/counted_loop_pass.hpp>
+#include <dwt/fusion_pass.hpp>
+#endif
+#if USE_REGISTER_OPS
+#include <dwt/register_pass.hpp>
+#endif
+#if USE_SUPERINSTRUCTIONS
+#include <dwt/superinstruction_pass.hpp>
+#endif
 #endif
 
 #include <memory>
@@ -114,6 +127,7 @@ void patch_jumps(code_obj &code) {
 
   while (off < code.size()) {
     uint16_t operand = 0;
+    uint8_t *jmp = op + 1;
     int nops = 0;
 
     switch (*op) {
@@ -133,14 +147,43 @@ void patch_jumps(code_obj &code) {
       operand = OPERAND(op + 1);
       nops = count_nops(op, operand);
       break;
+    case OP_BRZ_LT_RK:
+    case OP_BRZ_LTEQ_RK:
+    case OP_BRZ_GT_RK:
+    case OP_BRZ_GTEQ_RK:
+    case OP_BRZ_EQ_RK:
+    case OP_BRZ_NEQ_RK:
+    case OP_BRZ_LT_RR:
+    case OP_BRZ_LTEQ_RR:
+    case OP_BRZ_GT_RR:
+    case OP_BRZ_GTEQ_RR:
+    case OP_BRZ_EQ_RR:
+    case OP_BRZ_NEQ_RR:
+      // the branch follows the two operands being compared
+      jmp = op + 5;
+      operand = OPERAND(jmp);
+      nops = count_nops(op, operand);
+      break;
+    case OP_FORLOOP_LT_RK:
+    case OP_FORLOOP_LTEQ_RK:
+    case OP_FORLOOP_GT_RK:
+    case OP_FORLOOP_GTEQ_RK:
+    case OP_FORLOOP_LT_RR:
+    case OP_FORLOOP_LTEQ_RR:
+    case OP_FORLOOP_GT_RR:
+    case OP_FORLOOP_GTEQ_RR:
+      jmp = op + 5;
+      operand = OPERAND(jmp);
+      nops = count_nops((op + 1) - (operand), operand);
+      break;
     default:
       break;
     }
 
     if (nops) {
       operand -= nops;
-      op[1] = operand & 0xFF;
-      op[2] = (operand >> 8) & 0xFF;
+      jmp[0] = operand & 0xFF;
+      jmp[1] = (operand >> 8) & 0xFF;
     }
 
     off += 1 + opcode_operand_bytes(*op);
@@ -184,6 +227,70 @@ loop_info *find_loop_info(std::string identifier,
   return nullptr;
 }
 
+// an expression is known to leave a number when it is a numeric literal, a
+// name annotated ": num" or arithmetic on those. Annotated names are checked
+// whenever they are set so they can never hold anything else
+class is_num_expr : public ir::lazy_visitor {
+public:
+  is_num_expr() = default;
+  virtual ~is_num_expr() = default;
+
+  bool answer = false;
+
+  virtual void visit(ir::numeric_expr &expr) override {
+    answer = true;
+  }
+
+  virtual void visit(ir::scoped_name &name) override {
+    auto ref_scope = name.get_scope();
+    answer = ref_scope && ref_scope->type() == TYPE_NUM;
+  }
+
+  virtual void visit(ir::unary_expr &expr) override {
+    answer = expr.name_tok().type() != TOK_BANG && operands(expr);
+  }
+
+  virtual void visit(ir::add_expr &expr) override {
+    answer = operands(expr);
+  }
+
+  virtual void visit(ir::mult_expr &expr) override {
+    answer = operands(expr);
+  }
+
+  virtual void visit(ir::bitwise_expr &expr) override {
+    answer = operands(expr);
+  }
+
+  virtual void visit(ir::shift_expr &expr) override {
+    answer = operands(expr);
+  }
+
+  virtual void visit(ir::ast &node) override {
+  }
+
+  static bool test(ir::ast *expr) {
+    is_num_expr is_num;
+
+    if (expr) {
+      expr->accept(is_num);
+    }
+
+    return is_num.answer;
+  }
+
+private:
+  bool operands(ir::ast &expr) {
+    for (auto &operand : expr.children_of()) {
+      if (!test(operand.get())) {
+        return false;
+      }
+    }
+
+    return expr.nr_children() > 0;
+  }
+};
+
 } // namespace
 
 std::atomic<unsigned int> compiler::concurrency = 0;
@@ -437,6 +544,39 @@ opcode compiler::op_at(size_t off) {
   return current_code_obj().opcode_at(off);
 }
 
+/**
+ * Choose between an operator and its typed form, which needs both operands
+ * to be known numbers.
+ *
+ * @param expr The binary expression AST.
+ * @param op The operator.
+ * @param typed_op The typed form of the operator.
+ * @return The opcode to emit.
+ */
+opcode compiler::typed(ir::ast &expr, opcode op, opcode typed_op) {
+#if USE_TYPED_OPS
+  if (is_num_expr::test(expr.child_at(0)) &&
+      is_num_expr::test(expr.child_at(1))) {
+    return typed_op;
+  }
+#endif
+
+  return op;
+}
+
+/**
+ * Check the value on top of the stack is a number unless the expression
+ * that left it is already known to leave one.
+ *
+ * @param expr The expression AST.
+ * @param tok The token errors are reported against.
+ */
+void compiler::check_num(ir::ast *expr, token_ref tok) {
+  if (!is_num_expr::test(expr)) {
+    emit_op(OP_CHECK_NUM, tok);
+  }
+}
+
 /**
  * Get a reference to the current code_obj chunk.
  *
@@ -464,6 +604,16 @@ void compiler::optimise(code_obj &code) {
   { conditionals_pass pass(code); }
   { init_reload_pass pass(code); }
   { folding_pass pass(code); }
+#if USE_FUSED_OPS
+  { fusion_pass pass(code); }
+  { counted_loop_pass pass(code); }
+#endif
+#if USE_REGISTER_OPS
+  { register_pass pass(code); }
+#endif
+#if USE_SUPERINSTRUCTIONS
+  { superinstruction_pass pass(code); }
+#endif
 
   patch_jumps(code);
   remove_skips(code);
@@ -504,6 +654,11 @@ function_obj *compiler::operator()(ir::ast *tree) {
     emit_op(OP_SKIP);
 #endif
     emit_op(OP_NIL);
+
+    // falling off the end of a function annotated to return a number
+    if (_return_type == TYPE_NUM) {
+      emit_op(OP_CHECK_NUM, _return_tok);
+    }
   }
 
   emit_op(OP_RET);
@@ -516,6 +671,9 @@ function_obj *compiler::operator()(ir::ast *tree) {
   optimise(_fun_obj->code());
 #endif
 
+  _fun_obj->code().max_stack(
+    stack_depth(_fun_obj->code(), _fun_obj->arity() + 1).max());
+
   debug {
     decompiler decompiler(_fun_obj);
     decompiler.decompile();
@@ -553,12 +711,17 @@ void compiler::subcompile(function_obj *fun_obj, ir::ast *node) {
 /**
  * Finalise the given function object after compilation. This potentially
  * involves patching the closure opcode and compacting the code_obj
- * vector.
+ * vector. API methods of a class that capture nothing are added to the
+ * class method table rather than being bound to every instance.
  *
  * @param fun_obj The function object to finalise.
  */
 void compiler::finalise(function_obj *fun_obj) {
-  if (_fun_obj->type() == OBJ_CLASS || fun_obj->upvars().size() > 0) {
+  if (_fun_obj->type() == OBJ_CLASS && fun_obj->is_api() &&
+      fun_obj->upvars().size() == 0) {
+    static_cast<class_obj *>(_fun_obj)->add_method(fun_obj->short_name(),
+                                                   fun_obj);
+  } else if (_fun_obj->type() == OBJ_CLASS || fun_obj->upvars().size() > 0) {
     patch_closure(fun_obj);
   }
 
@@ -660,7 +823,13 @@ void compiler::visit(ir::scoped_name &name) {
   auto id_str = ref_scope->qualified_name();
 
   if (name.is_setter()) {
-    walk(name.parent_of()->child_at(1));
+    auto rhs = name.parent_of()->child_at(1);
+
+    walk(rhs);
+
+    if (ref_scope->type() == TYPE_NUM) {
+      check_num(rhs, name.get_token_range().from());
+    }
 
     if (ref_scope->is_global()) {
       emit_op(OP_STORE);
@@ -702,6 +871,14 @@ void compiler::visit(ir::scoped_name &name) {
 void compiler::visit(ir::parameter &param) {
   declare_variable(param);
   push();
+
+  // annotated parameters are checked once on entry
+  if (param.type() == TYPE_NUM) {
+    emit_op(OP_CHECK_NUM_R, param.name_tok());
+    emit_operand(_stack_pos - 1);
+    current_code_obj().token_at(current_code_obj().size() - 1,
+                                param.name_tok());
+  }
 }
 
 /**
@@ -848,6 +1025,9 @@ void compiler::visit(ir::unary_expr &expr) {
   case TOK_MINUS:
     emit_op(OP_NEG, expr.name_tok());
     break;
+  case TOK_TILDE:
+    emit_op(OP_BNOT, expr.name_tok());
+    break;
   default:
     break;
   }
@@ -863,12 +1043,37 @@ void compiler::visit(ir::primary_expr &expr) {
 }
 
 /**
- * Compile a call expression.
+ * Compile a call expression. Calling a member of an object compiles to a
+ * single INVOKE of the receiver rather than a member get and a call.
  *
  * @param call The expression AST.
  */
 void compiler::visit(ir::call_expr &call) {
-  walk(call.callee());
+  class is_member_expr : public ir::lazy_visitor {
+  public:
+    is_member_expr() = default;
+    virtual ~is_member_expr() = default;
+
+    ir::member_expr *answer = nullptr;
+
+    virtual void visit(ir::member_expr &expr) override {
+      answer = &expr;
+    }
+
+    virtual void visit(ir::ast &node) override {
+    }
+  };
+
+  is_member_expr is_member_expr;
+  call.callee()->accept(is_member_expr);
+
+  auto member = is_member_expr.answer;
+
+  if (member) {
+    walk(member->children_of());
+  } else {
+    walk(call.callee());
+  }
 
   size_t stack_pos = _stack_pos;
 
@@ -876,7 +1081,16 @@ void compiler::visit(ir::call_expr &call) {
     walk(call.args());
   }
 
-  emit_op(OP_CALL, call.name_tok());
+  if (member) {
+    obj *name = string_mgr::get().add_r(member->name());
+
+    emit_op(OP_INVOKE, call.name_tok());
+    emit_operand(constants::table().add_r(OBJ_AS_VAR(name)));
+    emit_operand(current_code_obj().add_invoke_cache());
+  } else {
+    emit_op(OP_CALL, call.name_tok());
+    emit_operand(current_code_obj().add_call_cache());
+  }
   emit_byte(call.num_args());
   current_code_obj().token_at(current_code_obj().size() - 1, call.name_tok());
 
@@ -893,10 +1107,56 @@ void compiler::visit(ir::mult_expr &expr) {
 
   switch (expr.gettok().type()) {
   case TOK_FWDSLASH:
-    emit_op(OP_DIV, expr.gettok());
+    emit_op(typed(expr, OP_DIV, OP_DIV_NN), expr.gettok());
     break;
   case TOK_STAR:
-    emit_op(OP_MUL, expr.gettok());
+    emit_op(typed(expr, OP_MUL, OP_MUL_NN), expr.gettok());
+    break;
+  case TOK_MODULO:
+    emit_op(OP_MOD, expr.gettok());
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * Compile a bitwise "and", "or" or "xor" expression.
+ *
+ * @param expr The expression AST.
+ */
+void compiler::visit(ir::bitwise_expr &expr) {
+  walk(expr.children_of());
+
+  switch (expr.gettok().type()) {
+  case TOK_AND:
+    emit_op(OP_BAND, expr.gettok());
+    break;
+  case TOK_OR:
+    emit_op(OP_BOR, expr.gettok());
+    break;
+  case TOK_XOR:
+    emit_op(OP_BXOR, expr.gettok());
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * Compile a shift expression.
+ *
+ * @param expr The expression AST.
+ */
+void compiler::visit(ir::shift_expr &expr) {
+  walk(expr.children_of());
+
+  switch (expr.gettok().type()) {
+  case TOK_LSHIFT:
+    emit_op(OP_SHL, expr.gettok());
+    break;
+  case TOK_RSHIFT:
+    emit_op(OP_SHR, expr.gettok());
     break;
   default:
     break;
@@ -917,7 +1177,7 @@ void compiler::visit(ir::add_expr &expr) {
       patch_op(code_obj_pos() - 1, OP_INC, expr.gettok());
       pop();
     } else {
-      emit_op(OP_ADD, expr.gettok());
+      emit_op(typed(expr, OP_ADD, OP_ADD_NN), expr.gettok());
     }
     break;
   case TOK_MINUS:
@@ -925,7 +1185,7 @@ void compiler::visit(ir::add_expr &expr) {
       patch_op(code_obj_pos() - 1, OP_DEC, expr.gettok());
       pop();
     } else {
-      emit_op(OP_SUB, expr.gettok());
+      emit_op(typed(expr, OP_SUB, OP_SUB_NN), expr.gettok());
     }
     break;
   default:
@@ -943,16 +1203,16 @@ void compiler::visit(ir::compare_expr &expr) {
 
   switch (expr.gettok().type()) {
   case TOK_GT:
-    emit_op(OP_GT, expr.gettok());
+    emit_op(typed(expr, OP_GT, OP_GT_NN), expr.gettok());
     break;
   case TOK_GT_EQ:
-    emit_op(OP_GTEQ, expr.gettok());
+    emit_op(typed(expr, OP_GTEQ, OP_GTEQ_NN), expr.gettok());
     break;
   case TOK_LT:
-    emit_op(OP_LT, expr.gettok());
+    emit_op(typed(expr, OP_LT, OP_LT_NN), expr.gettok());
     break;
   case TOK_LT_EQ:
-    emit_op(OP_LTEQ, expr.gettok());
+    emit_op(typed(expr, OP_LTEQ, OP_LTEQ_NN), expr.gettok());
     break;
   default:
     break;
@@ -1173,6 +1433,10 @@ void compiler::visit(ir::return_stmt &stmt) {
   } else {
     emit_op(OP_NIL);
   }
+  if (_return_type == TYPE_NUM) {
+    check_num(stmt.nr_children() > 0 ? stmt.child_at(0) : nullptr,
+              stmt.name_tok());
+  }
   emit_op(OP_RET);
 }
 
@@ -1186,6 +1450,10 @@ void compiler::for_loop(ir::loop_stmt &loop) {
     walk(loop.before());
   }
 
+  // a continue keeps the variables declared before the loop, they are
+  // still needed by the step
+  _continue_stack.back().stack_pos(_stack_pos);
+
   auto instr_before_cond = code_obj_pos();
 
   if (loop.cond()) {
@@ -1388,6 +1656,9 @@ void compiler::end_scope(size_t prev_pos) {
  * @param fun The function AST.
  */
 void compiler::visit(ir::function &fun) {
+  _return_type = fun.return_type();
+  _return_tok = fun.return_tok();
+
   if (fun.params()) {
     walk(fun.params());
   }
@@ -1428,7 +1699,14 @@ void compiler::visit(ir::var_decl &decl) {
 
   auto id_str = decl.qualified_name();
 
-  if (decl.children_of().size() == 0) {
+  if (decl.type() == TYPE_NUM) {
+    if (decl.children_of().size() == 0) {
+      emit_op(OP_ZERO);
+    } else {
+      walk(decl.children_of());
+      check_num(decl.child_at(0), decl.name_tok());
+    }
+  } else if (decl.children_of().size() == 0) {
     emit_op(OP_NIL);
   } else {
     walk(decl.children_of());
@@ -1575,11 +1853,12 @@ void compiler::visit(ir::member_expr &expr) {
   if (expr.is_setter()) {
     walk(expr.parent_of()->child_at(1));
     emit_op(OP_MBRSET);
-    emit_operand(constants::table().add_r(OBJ_AS_VAR(obj)));
   } else {
     emit_op(OP_MBRGET);
-    emit_operand(constants::table().add_r(OBJ_AS_VAR(obj)));
   }
+
+  emit_operand(constants::table().add_r(OBJ_AS_VAR(obj)));
+  emit_operand(current_code_obj().add_member_cache());
 }
 
 /**
@@ -1732,6 +2011,7 @@ void compiler::visit(ir::lambda_expr &expr) {
   walk(expr.impl());
   walk(expr.args());
   emit_op(OP_CALL);
+  emit_operand(current_code_obj().add_call_cache());
   emit_byte(expr.args()->nr_children());
 }
 
@@ -1750,6 +2030,10 @@ void compiler::visit(ir::lambda &lambda) {
  * @param stmt The statement AST.
  */
 void compiler::visit(ir::break_stmt &stmt) {
+  // the pops only happen on the way out of the loop, the code following
+  // the break still sees the stack as it was
+  size_t stack_pos = _stack_pos;
+
   if (stmt.name() != "") {
     auto info = find_loop_info(stmt.name(), _break_stack);
 
@@ -1770,6 +2054,8 @@ void compiler::visit(ir::break_stmt &stmt) {
     auto jump_pos = mark_jump(OP_BRA, TBD);
     _break_stack.back().add_patch_point(jump_pos);
   }
+
+  _stack_pos = stack_pos;
 }
 
 /**
@@ -1778,6 +2064,7 @@ void compiler::visit(ir::break_stmt &stmt) {
  * @param stmt The statement AST.
  */
 void compiler::visit(ir::continue_stmt &stmt) {
+  size_t stack_pos = _stack_pos;
 
   if (stmt.name() != "") {
     auto info = find_loop_info(stmt.name(), _continue_stack);
@@ -1799,6 +2086,8 @@ void compiler::visit(ir::continue_stmt &stmt) {
     auto jump_pos = mark_jump(OP_LOOP, TBD);
     _continue_stack.back().add_patch_point(jump_pos);
   }
+
+  _stack_pos = stack_pos;
 }
 
 /**
@@ -1817,6 +2106,7 @@ void compiler::visit(ir::map_expr &expr) {
   subcompile(map_obj, expr.child_at(0));
 
   emit_op(OP_CALL);
+  emit_operand(current_code_obj().add_call_cache());
   emit_byte(0); // 0 arguments
 }
 
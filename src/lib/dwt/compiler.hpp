@@ -47,6 +47,10 @@ public:
     return _stack_pos;
   }
 
+  void stack_pos(size_t stack_pos) {
+    _stack_pos = stack_pos;
+  }
+
   std::string name() const {
     return _identifier;
   }
@@ -130,6 +134,8 @@ public:
   virtual void visit(ir::break_stmt &);
   virtual void visit(ir::continue_stmt &);
   virtual void visit(ir::map_expr &);
+  virtual void visit(ir::bitwise_expr &);
+  virtual void visit(ir::shift_expr &);
 
 private:
   void subcompile(function_obj *, ir::ast *);
@@ -180,6 +186,8 @@ private:
   void patch_upvar(uint32_t);
   void patch_closure(function_obj *);
   opcode op_at(size_t off);
+  opcode typed(ir::ast &, opcode, opcode);
+  void check_num(ir::ast *, token_ref);
   code_obj &current_code_obj();
 
   size_t code_obj_pos() {
@@ -223,6 +231,8 @@ private:
   uint8_t _prev_op;
   std::vector<loop_info> _continue_stack;
   std::vector<loop_info> _break_stack;
+  value_type _return_type = TYPE_ANY;
+  token_ref _return_tok;
 #if USE_THREADED_COMPILER
   std::mutex _mutex;
   std::vector<std::shared_future<function_obj *>> _fun_objs;
@@ -0,0 +1,116 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#include <dwt/counted_loop_pass.hpp>
+
+#define OPERAND(op) ((*(op)) | ((*((op) + 1)) << 8))
+
+namespace dwt {
+
+namespace {
+
+struct loop_form {
+  opcode test_op; // enters the loop
+  opcode step_op;
+  opcode loop_op;
+};
+
+const loop_form forms[] = {
+  { OP_BRZ_LT_RK, OP_INC_R, OP_FORLOOP_LT_RK },
+  { OP_BRZ_LTEQ_RK, OP_INC_R, OP_FORLOOP_LTEQ_RK },
+  { OP_BRZ_GT_RK, OP_DEC_R, OP_FORLOOP_GT_RK },
+  { OP_BRZ_GTEQ_RK, OP_DEC_R, OP_FORLOOP_GTEQ_RK },
+  { OP_BRZ_LT_RR, OP_INC_R, OP_FORLOOP_LT_RR },
+  { OP_BRZ_LTEQ_RR, OP_INC_R, OP_FORLOOP_LTEQ_RR },
+  { OP_BRZ_GT_RR, OP_DEC_R, OP_FORLOOP_GT_RR },
+  { OP_BRZ_GTEQ_RR, OP_DEC_R, OP_FORLOOP_GTEQ_RR },
+};
+
+const loop_form *find_form(opcode test_op, opcode step_op) {
+  for (auto &form : forms) {
+    if (form.test_op == test_op && form.step_op == step_op) {
+      return &form;
+    }
+  }
+
+  return nullptr;
+}
+
+} // namespace
+
+/**
+ * Close counted loops with a single op. A loop such as
+ * "loop for var i = 0, i < n, i := i + 1" is entered through a BRZ_LT_RR
+ * and closed by INC_R and LOOP, which branches back to the test. The step
+ * and the back edge are replaced by FORLOOP_LT_RR, which also makes the
+ * test and branches straight back to the body. The entry test is kept
+ * since it is still needed on the way in.
+ *
+ * @param code The code object to optimise.
+ */
+counted_loop_pass::counted_loop_pass(code_obj &code)
+  : peephole({ { { OP_INC_R, OP_LOOP }, 6 }, { { OP_DEC_R, OP_LOOP }, 6 } })
+  , _code(code) {
+
+  (*this)(code);
+}
+
+counted_loop_pass::~counted_loop_pass() {
+}
+
+void counted_loop_pass::peep(uint8_t *op, size_t extent) {
+  uint8_t *code = _code.entry();
+  size_t off = op - code;
+  size_t loop = 3;
+
+  while (loop < extent && op[loop] == OP_SKIP) {
+    ++loop;
+  }
+
+  size_t end = loop + 3;
+  size_t entry = off + loop + 1 - OPERAND(op + loop + 1);
+  uint8_t *test = code + entry;
+  auto form = find_form(test[0], op[0]);
+
+  // there must be room for the loop op and the test must be for the local
+  // being stepped
+  if (end < 7 || !form || OPERAND(test + 1) != OPERAND(op + 1)) {
+    return;
+  }
+
+  // and must leave the loop to just after the back edge
+  size_t exit = entry + 1 + OPERAND(test + 5);
+
+  if (exit < off + end) {
+    return;
+  }
+  for (size_t pos = off + end; pos < exit; ++pos) {
+    if (code[pos] != OP_SKIP) {
+      return;
+    }
+  }
+
+  // relative to the first operand byte as for LOOP, the body follows the
+  // test immediately once skips are removed
+  uint16_t body = (off + 1) - (entry + 7);
+
+  op[0] = form->loop_op;
+  op[3] = test[3];
+  op[4] = test[4];
+  op[5] = body & 0xFF;
+  op[6] = (body >> 8) & 0xFF;
+  for (size_t i = 7; i < end; ++i) {
+    op[i] = OP_SKIP;
+  }
+}
+
+bool counted_loop_pass::spans_skips() const {
+  return true;
+}
+
+} // namespace dwt
@@ -0,0 +1,30 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#ifndef GUARD_DWT_COUNTED_LOOP_PASS_HPP
+#define GUARD_DWT_COUNTED_LOOP_PASS_HPP
+
+#include <dwt/peephole.hpp>
+
+namespace dwt {
+
+class counted_loop_pass : public peephole {
+public:
+  counted_loop_pass(code_obj &);
+  virtual ~counted_loop_pass();
+
+private:
+  virtual void peep(uint8_t *op, size_t extent) override;
+  virtual bool spans_skips() const override;
+
+  code_obj &_code;
+};
+
+} // namespace dwt
+
+#endif
@@ -24,6 +24,7 @@ namespace dwt {
 decompiler::decompiler(function_obj *function_obj)
   : _fun_obj(function_obj)
   , _ip(0)
+  , _op_ip(0)
   , _op(0)
   , _pass(1) {
 }
@@ -96,12 +97,11 @@ void decompiler::emit(std::string op) {
 void decompiler::emit(std::string op, std::string operand) {
   if (_pass == 2) {
     char strbuf[256];
-    size_t offset = op == "CALL" ? _ip - 2 : _ip - 3;
 
     snprintf(strbuf,
              256,
              "\t%04x\t%s\t%s\n",
-             (unsigned int) offset,
+             (unsigned int) _op_ip,
              op.c_str(),
              operand.c_str());
 
@@ -158,15 +158,34 @@ void decompiler::op_bnz() {
 }
 
 void decompiler::op_call() {
-  uint8_t operand;
-  read(operand);
-  std::string oper_str = std::to_string(operand);
+  int32_t cache;
+  uint8_t nr_args;
+  read(cache);
+  read(nr_args);
+  std::string oper_str = "#" + std::to_string(cache);
+  oper_str += "\t" + std::to_string(nr_args);
 
   if (_pass == 2) {
     emit(decode(OP_CALL), oper_str);
   }
 }
 
+void decompiler::op_invoke() {
+  int32_t operand;
+  int32_t cache;
+  uint8_t nr_args;
+  read(operand);
+  read(cache);
+  read(nr_args);
+  std::string oper_str = var_to_string(constants::table().get(operand));
+  oper_str += "\t#" + std::to_string(cache);
+  oper_str += "\t" + std::to_string(nr_args);
+
+  if (_pass == 2) {
+    emit(decode(OP_INVOKE), oper_str);
+  }
+}
+
 void decompiler::op_closure() {
   int32_t operand;
   read(operand);
@@ -200,8 +219,11 @@ void decompiler::op_load_c() {
 
 void decompiler::op_mbrget() {
   int32_t operand;
+  int32_t cache;
   read(operand);
+  read(cache);
   std::string oper_str = var_to_string(constants::table().get(operand));
+  oper_str += "\t#" + std::to_string(cache);
 
   if (_pass == 2) {
     emit(decode(OP_MBRGET), oper_str);
@@ -210,8 +232,11 @@ void decompiler::op_mbrget() {
 
 void decompiler::op_mbrset() {
   int32_t operand;
+  int32_t cache;
   read(operand);
+  read(cache);
   std::string oper_str = var_to_string(constants::table().get(operand));
+  oper_str += "\t#" + std::to_string(cache);
 
   if (_pass == 2) {
     emit(decode(OP_MBRSET), oper_str);
@@ -273,10 +298,71 @@ void decompiler::op_popn() {
   }
 }
 
-void decompiler::op_tailcall() {
-  uint8_t operand;
+void decompiler::op_registers(opcode op) {
+  std::string oper_str;
+
+  for (int i = 0; i < opcode_operand_bytes(op); i += 2) {
+    int32_t operand;
+    read(operand);
+    if (i) {
+      oper_str += "\t";
+    }
+    oper_str += std::to_string(operand);
+  }
+
+  if (_pass == 2) {
+    emit(decode(op), oper_str);
+  }
+}
+
+void decompiler::op_register_const(opcode op) {
+  int32_t reg;
+  int32_t operand;
+  read(reg);
   read(operand);
-  std::string oper_str = std::to_string(operand);
+  std::string oper_str = std::to_string(reg);
+  oper_str += "\t" + var_to_string(constants::table().get(operand));
+
+  if (_pass == 2) {
+    emit(decode(op), oper_str);
+  }
+}
+
+void decompiler::op_compare_branch(opcode op, bool rhs_is_const, bool back) {
+  int32_t lhs;
+  int32_t rhs;
+  int32_t addr;
+  read(lhs);
+  read(rhs);
+  read(addr);
+  if (back) {
+    addr = -addr;
+  }
+  // the branch is relative to the first operand rather than to the last
+  addr -= 4;
+
+  if (_pass == 1) {
+    mark_jmp(addr);
+  } else {
+    std::string oper_str = std::to_string(lhs) + "\t";
+    if (rhs_is_const) {
+      oper_str += var_to_string(constants::table().get(rhs));
+    } else {
+      oper_str += std::to_string(rhs);
+    }
+    oper_str += "\t" + to_label(addr);
+    emit(decode(op), oper_str);
+  }
+}
+
+void decompiler::op_tailcall() {
+  int32_t cache;
+  uint8_t nr_args;
+  read(cache);
+  read(nr_args);
+  std::string oper_str = "#" + std::to_string(cache);
+  oper_str += "\t" + std::to_string(nr_args);
+
   if (_pass == 2) {
     emit(decode(OP_TAILCALL), oper_str);
   }
@@ -305,6 +391,8 @@ void decompiler::pass() {
   }
 
   do {
+    _op_ip = _ip;
+
     switch (op = accept()) {
     case OP_LOOP:
       op_loop();
@@ -321,6 +409,9 @@ void decompiler::pass() {
     case OP_CALL:
       op_call();
       break;
+    case OP_INVOKE:
+      op_invoke();
+      break;
     case OP_GET:
       op_get();
       break;
@@ -357,8 +448,76 @@ void decompiler::pass() {
     case OP_TAILCALL:
       op_tailcall();
       break;
+    case OP_MOVE:
+    case OP_ADD_RR:
+    case OP_SUB_RR:
+    case OP_MUL_RR:
+    case OP_DIV_RR:
+    case OP_LT_RR:
+    case OP_LTEQ_RR:
+    case OP_GT_RR:
+    case OP_GTEQ_RR:
+    case OP_EQ_RR:
+    case OP_NEQ_RR:
+    case OP_ADD_RRR:
+    case OP_SUB_RRR:
+    case OP_MUL_RRR:
+    case OP_DIV_RRR:
+    case OP_ADD_RR_NN:
+    case OP_SUB_RR_NN:
+    case OP_MUL_RR_NN:
+    case OP_DIV_RR_NN:
+    case OP_LT_RR_NN:
+    case OP_LTEQ_RR_NN:
+    case OP_GT_RR_NN:
+    case OP_GTEQ_RR_NN:
+    case OP_ADD_RRR_NN:
+    case OP_SUB_RRR_NN:
+    case OP_MUL_RRR_NN:
+    case OP_DIV_RRR_NN:
+    case OP_INC_R:
+    case OP_DEC_R:
+    case OP_CHECK_NUM_R:
+#define SUPER(super_op, ...) case OP_##super_op:
+#include <dwt/superinstructions.inc>
+#undef SUPER
+      op_registers(op);
+      break;
+    case OP_ADD_RK:
+    case OP_SUB_RK:
+      op_register_const(op);
+      break;
+    case OP_BRZ_LT_RK:
+    case OP_BRZ_LTEQ_RK:
+    case OP_BRZ_GT_RK:
+    case OP_BRZ_GTEQ_RK:
+    case OP_BRZ_EQ_RK:
+    case OP_BRZ_NEQ_RK:
+      op_compare_branch(op, true, false);
+      break;
+    case OP_BRZ_LT_RR:
+    case OP_BRZ_LTEQ_RR:
+    case OP_BRZ_GT_RR:
+    case OP_BRZ_GTEQ_RR:
+    case OP_BRZ_EQ_RR:
+    case OP_BRZ_NEQ_RR:
+      op_compare_branch(op, false, false);
+      break;
+    case OP_FORLOOP_LT_RK:
+    case OP_FORLOOP_LTEQ_RK:
+    case OP_FORLOOP_GT_RK:
+    case OP_FORLOOP_GTEQ_RK:
+      op_compare_branch(op, true, true);
+      break;
+    case OP_FORLOOP_LT_RR:
+    case OP_FORLOOP_LTEQ_RR:
+    case OP_FORLOOP_GT_RR:
+    case OP_FORLOOP_GTEQ_RR:
+      op_compare_branch(op, false, true);
+      break;
     default:
       emit(decode(op));
+      _ip += opcode_operand_bytes(op);
       break;
     }
   } while (_ip < _fun_obj->code().size());
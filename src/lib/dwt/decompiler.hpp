@@ -80,6 +80,7 @@ private:
   void op_brz();
   void op_bnz();
   void op_call();
+  void op_invoke();
   void op_const();
   void op_get();
   void op_set();
@@ -93,11 +94,15 @@ private:
   void op_store();
   void op_popn();
   void op_tailcall();
+  void op_registers(opcode);
+  void op_register_const(opcode);
+  void op_compare_branch(opcode, bool rhs_is_const, bool back);
 
   hash_map _labels;
 
   function_obj *_fun_obj;
   size_t _ip;
+  size_t _op_ip;
   uint8_t _op;
   unsigned int _pass;
 };
@@ -155,6 +155,9 @@ void folding_pass::peep(uint8_t *op, size_t extent) {
       case OP_DEC:
         fold(op, off, var_dec(x));
         return;
+      case OP_BNOT:
+        fold(op, off, var_bnot(x));
+        return;
       default:
         return;
       }
@@ -163,17 +166,39 @@ void folding_pass::peep(uint8_t *op, size_t extent) {
 
     switch (op[off]) {
     case OP_ADD:
+    case OP_ADD_NN:
       fold(op, off, var_add(x, y));
       return;
     case OP_SUB:
+    case OP_SUB_NN:
       fold(op, off, var_sub(x, y));
       return;
     case OP_MUL:
+    case OP_MUL_NN:
       fold(op, off, var_mul(x, y));
       return;
     case OP_DIV:
+    case OP_DIV_NN:
       fold(op, off, var_div(x, y));
       return;
+    case OP_MOD:
+      fold(op, off, var_mod(x, y));
+      return;
+    case OP_SHL:
+      fold(op, off, var_shl(x, y));
+      return;
+    case OP_SHR:
+      fold(op, off, var_shr(x, y));
+      return;
+    case OP_BAND:
+      fold(op, off, var_band(x, y));
+      return;
+    case OP_BOR:
+      fold(op, off, var_bor(x, y));
+      return;
+    case OP_BXOR:
+      fold(op, off, var_bxor(x, y));
+      return;
     case OP_LT:
       break;
     case OP_LTEQ:
@@ -10,6 +10,7 @@
 #include <dwt/decompiler.hpp>
 #include <dwt/function_obj.hpp>
 #include <dwt/interpreter.hpp>
+#include <dwt/jit.hpp>
 #include <dwt/scope.hpp>
 #include <dwt/string_mgr.hpp>
 
@@ -41,6 +42,9 @@ function_obj::function_obj(const function_obj &other)
 }
 
 function_obj::~function_obj() {
+#if JIT_ENABLED
+  jit::release(this);
+#endif
 }
 
 obj_type function_obj::type() {
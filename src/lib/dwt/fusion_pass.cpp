@@ -0,0 +1,217 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#include <dwt/constants.hpp>
+#include <dwt/fusion_pass.hpp>
+
+#define OPERAND(op) ((*(op)) | ((*((op) + 1)) << 8))
+
+namespace dwt {
+
+namespace {
+
+struct branch_form {
+  opcode compare_op;
+  opcode rk_op; // compares a local with a constant
+  opcode rr_op; // compares two locals
+};
+
+const branch_form forms[] = {
+  { OP_LT, OP_BRZ_LT_RK, OP_BRZ_LT_RR },
+  { OP_LTEQ, OP_BRZ_LTEQ_RK, OP_BRZ_LTEQ_RR },
+  { OP_GT, OP_BRZ_GT_RK, OP_BRZ_GT_RR },
+  { OP_GTEQ, OP_BRZ_GTEQ_RK, OP_BRZ_GTEQ_RR },
+  { OP_EQ, OP_BRZ_EQ_RK, OP_BRZ_EQ_RR },
+  { OP_NEQ, OP_BRZ_NEQ_RK, OP_BRZ_NEQ_RR },
+  // the fused forms of typed comparisons are the same, a test and branch
+  // is worth more than the tag check it keeps
+  { OP_LT_NN, OP_BRZ_LT_RK, OP_BRZ_LT_RR },
+  { OP_LTEQ_NN, OP_BRZ_LTEQ_RK, OP_BRZ_LTEQ_RR },
+  { OP_GT_NN, OP_BRZ_GT_RK, OP_BRZ_GT_RR },
+  { OP_GTEQ_NN, OP_BRZ_GTEQ_RK, OP_BRZ_GTEQ_RR },
+};
+
+const opcode constant_ops[] = { OP_CONST, OP_ZERO, OP_ONE, OP_TWO };
+
+std::vector<ph_pattern> patterns() {
+  std::vector<ph_pattern> patterns;
+
+  for (auto &form : forms) {
+    for (auto k : constant_ops) {
+      patterns.push_back({ { OP_GET, k, form.compare_op, OP_BRZ },
+                           8 + opcode_operand_bytes(k) });
+    }
+    patterns.push_back({ { OP_GET, OP_GET, form.compare_op, OP_BRZ }, 10 });
+  }
+  for (auto k : constant_ops) {
+    for (auto arith : { OP_ADD, OP_SUB, OP_ADD_NN, OP_SUB_NN }) {
+      patterns.push_back({ { OP_GET, k, arith }, 5 + opcode_operand_bytes(k) });
+    }
+  }
+  for (auto step : { OP_INC, OP_DEC }) {
+    patterns.push_back({ { OP_GET, step, OP_SET, OP_POP }, 8 });
+    // the pop may have been merged with those leaving a scope
+    patterns.push_back({ { OP_GET, step, OP_SET, OP_POPN }, 9 });
+  }
+
+  return patterns;
+}
+
+const branch_form *find_form(opcode op) {
+  for (auto &form : forms) {
+    if (form.compare_op == op) {
+      return &form;
+    }
+  }
+
+  return nullptr;
+}
+
+bool is_constant(opcode op) {
+  for (auto k : constant_ops) {
+    if (k == op) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// adding or subtracting a constant has register forms, typed or not
+bool is_arith(opcode op) {
+  switch (op) {
+  case OP_ADD:
+  case OP_SUB:
+  case OP_ADD_NN:
+  case OP_SUB_NN:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// the index of the constant pushed by op, small numbers have their own ops
+// and so are added to the table when first used as an operand
+uint16_t constant_index(uint8_t *op) {
+  switch (*op) {
+  case OP_ZERO:
+    return constants::table().add_r(NUM_AS_VAR(0.0));
+  case OP_ONE:
+    return constants::table().add_r(NUM_AS_VAR(1.0));
+  case OP_TWO:
+    return constants::table().add_r(NUM_AS_VAR(2.0));
+  default:
+    return OPERAND(op + 1);
+  }
+}
+
+} // namespace
+
+/**
+ * Fuse the sequences found in tight loops into single ops. A condition
+ * such as "i < 10" in an if or loop statement becomes one BRZ_LT_RK rather
+ * than GET, CONST, LT and BRZ, "n - 2" becomes SUB_RK and "i := i + 1"
+ * becomes INC_R.
+ *
+ * @param code The code object to optimise.
+ */
+fusion_pass::fusion_pass(code_obj &code)
+  : peephole(patterns())
+  , _code(code) {
+
+  (*this)(code);
+}
+
+fusion_pass::~fusion_pass() {
+}
+
+void fusion_pass::peep(uint8_t *op, size_t extent) {
+  size_t off = op - _code.entry();
+  size_t at[4];
+  size_t n = 0;
+
+  // the match may span skips left by the compiler and earlier passes
+  for (size_t pos = 0; n < 4 && pos < extent;
+       pos += 1 + opcode_operand_bytes(op[pos])) {
+    if (op[pos] != OP_SKIP) {
+      at[n++] = pos;
+    }
+  }
+
+  if (n < 3) {
+    return;
+  }
+
+  auto form = find_form(op[at[2]]);
+
+  if (form && n == 4 && op[at[3]] == OP_BRZ &&
+      (op[at[1]] == OP_GET || is_constant(op[at[1]]))) {
+    bool rr = op[at[1]] == OP_GET;
+    uint16_t rhs = rr ? OPERAND(op + at[1] + 1) : constant_index(op + at[1]);
+    // relative to the first operand byte as for BRZ
+    uint16_t target = at[3] + OPERAND(op + at[3] + 1);
+    size_t end = at[3] + 3;
+
+    // errors raised by the comparison still map to the comparison token
+    _code.token_at(off, _code.token_at(off + at[2]));
+
+    op[0] = rr ? form->rr_op : form->rk_op;
+    op[3] = rhs & 0xFF;
+    op[4] = (rhs >> 8) & 0xFF;
+    op[5] = target & 0xFF;
+    op[6] = (target >> 8) & 0xFF;
+    for (size_t i = 7; i < end; ++i) {
+      op[i] = OP_SKIP;
+    }
+  } else if (is_arith(op[at[2]]) && is_constant(op[at[1]])) {
+    uint16_t rhs = constant_index(op + at[1]);
+    size_t end = at[2] + 1;
+    bool add = op[at[2]] == OP_ADD || op[at[2]] == OP_ADD_NN;
+
+    _code.token_at(off, _code.token_at(off + at[2]));
+
+    op[0] = add ? OP_ADD_RK : OP_SUB_RK;
+    op[3] = rhs & 0xFF;
+    op[4] = (rhs >> 8) & 0xFF;
+    for (size_t i = 5; i < end; ++i) {
+      op[i] = OP_SKIP;
+    }
+  } else if (n == 4 && (op[at[1]] == OP_INC || op[at[1]] == OP_DEC) &&
+             op[at[2]] == OP_SET &&
+             (op[at[3]] == OP_POP || op[at[3]] == OP_POPN) &&
+             OPERAND(op + 1) == OPERAND(op + at[2] + 1)) {
+    opcode reg_op = op[at[1]] == OP_INC ? OP_INC_R : OP_DEC_R;
+    size_t end = at[3] + 1 + opcode_operand_bytes(op[at[3]]);
+    size_t i = 3;
+
+    _code.token_at(off, _code.token_at(off + at[1]));
+
+    // nothing was pushed so one fewer value is popped
+    if (op[at[3]] == OP_POPN) {
+      uint8_t pop_count = op[at[3] + 1] - 1;
+
+      if (pop_count > 1) {
+        op[i++] = OP_POPN;
+        op[i++] = pop_count;
+      } else {
+        op[i++] = OP_POP;
+      }
+    }
+
+    op[0] = reg_op;
+    while (i < end) {
+      op[i++] = OP_SKIP;
+    }
+  }
+}
+
+bool fusion_pass::spans_skips() const {
+  return true;
+}
+
+} // namespace dwt
@@ -6,10 +6,12 @@
 //
 // Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
 
+#include <dwt/code_obj.hpp>
 #include <dwt/constants.hpp>
 #include <dwt/garbage_collector.hpp>
 #include <dwt/globals.hpp>
 #include <dwt/interpreter.hpp>
+#include <dwt/shape.hpp>
 #include <dwt/string_mgr.hpp>
 
 namespace dwt {
@@ -82,6 +84,8 @@ void garbage_collector::collect_garbage() {
   constants::table().get_all().for_all([this](auto &v) { mark(v); });
   dbg("-- marking global roots\n");
   globals::table().get_all().for_all([this](auto &v) { mark(v); });
+  dbg("-- marking shape roots\n");
+  shape::for_all_shapes([this](auto s) { mark(s->key()); });
 
   dbg("-- marking interpreter roots\n");
 
@@ -119,6 +123,13 @@ void garbage_collector::sweep() {
 
   string_mgr::get().sweep();
 
+  // call site caches do not keep their callees alive
+  for (auto c = _objs; c; c = c->next()) {
+    if (c->marked_as() == MARK_GREY && c->type() == OBJ_CODE) {
+      static_cast<code_obj *>(c)->sweep_callees();
+    }
+  }
+
   while (o) {
     if (o->marked_as() == MARK_GREY) {
       o->mark_as(MARK_WHITE);
@@ -140,6 +151,17 @@ void garbage_collector::sweep() {
     }
   }
 
+  // nor do they keep layouts alive, those released by the objects just
+  // freed can go once no cache refers to them
+  if (shape::has_retired()) {
+    for (auto c = _objs; c; c = c->next()) {
+      if (c->type() == OBJ_CODE) {
+        static_cast<code_obj *>(c)->sweep_layouts();
+      }
+    }
+    shape::free_retired();
+  }
+
   is_waiting = false;
 }
 
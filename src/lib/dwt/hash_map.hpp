@@ -33,7 +33,7 @@ public:
   bool del(var key);
   kv_pair *get(var key) const;
 
-  template <typename Fn> void for_all(Fn f) {
+  template <typename Fn> void for_all(Fn f) const {
     for (size_t i = 0; i < _capacity; ++i) {
       auto entry = &_buckets[i];
 
@@ -11,9 +11,20 @@
 
 namespace dwt {
 
+namespace {
+
+inline bool is_slot_key(var key) {
+  return VAR_IS_OBJ(key) && VAR_AS_OBJ(key)->type() == OBJ_STRING;
+}
+
+} // namespace
+
 instance_obj::instance_obj(class_obj *klass)
   : _super(nullptr)
-  , _klass(klass) {
+  , _klass(klass)
+  , _shape(klass ? klass->layout() : shape::make_root()) {
+
+  _shape->acquire();
 }
 
 instance_obj::instance_obj(const instance_obj &other)
@@ -30,9 +41,22 @@ instance_obj::instance_obj(const instance_obj &other)
   } else {
     _klass = nullptr;
   }
+
+  // the cloned class shares the layouts of the original
+  _shape = other._shape;
+  _shape->acquire();
+
+  for (auto value : other._slots) {
+    if (VAR_IS_OBJ(value)) {
+      value = OBJ_AS_VAR(VAR_AS_OBJ(value)->clone());
+    }
+
+    _slots.push_back(value);
+  }
 }
 
 instance_obj::~instance_obj() {
+  _shape->release();
 }
 
 obj_type instance_obj::type() {
@@ -43,6 +67,13 @@ obj *instance_obj::clone() {
   return new instance_obj(*this);
 }
 
+/**
+ * Set the super instance. Members not found in this instance or its class
+ * are looked up in the super instance each time, so later changes to it
+ * are seen through this instance.
+ *
+ * @param s The super instance.
+ */
 void instance_obj::super(instance_obj *s) {
   _super = s;
 }
@@ -61,33 +92,101 @@ void instance_obj::blacken() {
   }
   _klass->mark_as(MARK_GREY);
 
+  for (auto &value : _slots) {
+    if (VAR_IS_OBJ(value)) {
+      VAR_AS_OBJ(value)->mark_as(MARK_GREY);
+    }
+  }
+
   map_obj::blacken();
 }
 
+size_t instance_obj::length() {
+  return _slots.size() + map_obj::length();
+}
+
 void instance_obj::call(interpreter &interpreter, int nr_args) {
   interpreter.invoke(this, nr_args);
 }
 
 var instance_obj::op_mbrget(var key) {
+  int idx = _shape->find(key);
+
+  if (idx >= 0) {
+    return _slots[idx];
+  }
+
   auto kv = _map.get(key);
 
   if (kv) {
     return kv->value;
-  } else if (_super) {
+  }
+
+  var method = _klass->method(key);
+
+  if (method == nil && _super) {
     return _super->op_mbrget(key);
   }
 
-  return nil;
+  return method;
 }
 
 void instance_obj::op_mbrset(var key, var value) {
-  auto kv = _map.get(key);
+  int idx = _shape->find(key);
 
-  if (kv) {
-    kv->value = value;
-  } else if (_super) {
-    _super->op_mbrset(key, value);
+  if (idx >= 0) {
+    _slots[idx] = value;
+  } else {
+    auto kv = _map.get(key);
+
+    if (kv) {
+      kv->value = value;
+    } else if (_klass->method(key) != nil) {
+      // shadow the class method for this instance only
+      op_keyset(key, value);
+    } else if (_super) {
+      _super->op_mbrset(key, value);
+    }
+  }
+}
+
+var instance_obj::op_keyget(var key) {
+  int idx = _shape->find(key);
+
+  if (idx >= 0) {
+    return _slots[idx];
+  }
+
+  if (_map.size() > 0) {
+    auto kv = _map.get(key);
+
+    if (kv) {
+      return kv->value;
+    }
   }
+
+  return _klass->method(key);
+}
+
+void instance_obj::op_keyset(var key, var value) {
+  if (is_slot_key(key)) {
+    int idx = _shape->find(key);
+
+    if (idx >= 0) {
+      _slots[idx] = value;
+      return;
+    }
+
+    shape *next = _shape->add(key);
+
+    if (next) {
+      _shape = next;
+      _slots.push_back(value);
+      return;
+    }
+  }
+
+  map_obj::op_keyset(key, value);
 }
 
 } // namespace dwt
@@ -17,16 +17,42 @@
 #include <dwt/instance_obj.hpp>
 #include <dwt/interpret_exception.hpp>
 #include <dwt/interpreter.hpp>
+#include <dwt/jit.hpp>
 #include <dwt/opcode.hpp>
+#include <dwt/opcode_profile.hpp>
 #include <dwt/reporting.hpp>
 #include <dwt/scope.hpp>
+#include <dwt/string_mgr.hpp>
+#include <dwt/string_obj.hpp>
+#include <dwt/threaded_code.hpp>
 #include <dwt/var.hpp>
 
 #include <algorithm>
 #include <cassert>
 #include <map>
 
-#define PUSH(x) exec_stack.push(x)
+#if USE_TOS_CACHE
+
+// the top of the stack is also held in tos, which is written through to the
+// stack so that anything else reading the stack sees it. Whatever changes
+// the stack behind the interpreter's back is followed by TOS_FILL()
+#define TOS_FILL() (tos = exec_stack.top())
+#define PUSH(x) (tos = (x), exec_stack.push_reserved(tos))
+#define TOP() tos
+#define TOPN(n) exec_stack.top(n)
+#define TOP_SWAP(x) (tos = (x), exec_stack.top_swap(tos))
+#define POP() (exec_stack.pop(), TOS_FILL())
+#define POPN(n) (exec_stack.pop(n), TOS_FILL())
+#define TOP_AND_POP() (popped = tos, POP(), popped)
+#define POP_AND_SWAP(v) (tos = (v), exec_stack.pop_and_swap(tos))
+#define POPN_AND_SWAP(n, v) (tos = (v), exec_stack.pop_and_swap(n, tos))
+#define GET(n) exec_stack.get(n)
+#define SET(n, v) (exec_stack.set(n, v), TOS_FILL())
+
+#else
+
+#define TOS_FILL()
+#define PUSH(x) exec_stack.push_reserved(x)
 #define TOP() exec_stack.top()
 #define TOPN(n) exec_stack.top(n)
 #define TOP_SWAP(x) exec_stack.top_swap(x)
@@ -38,6 +64,8 @@
 #define GET(n) exec_stack.get(n)
 #define SET(n, v) exec_stack.set(n, v)
 
+#endif
+
 #define GC_MAYBE()                                 \
   do {                                             \
     if (unlikely(garbage_collector::is_waiting)) { \
@@ -60,10 +88,212 @@
   do {                   \
     op = TOP_FRAME().ip; \
     fp = TOP_FRAME().sp; \
+    TOS_FILL();          \
   } while (0)
 
+// rewrite the current op in place with its quickened form, or revert it to
+// the generic form once the quickened form sees operands it cannot handle
+#if THREADING_ENABLED
+#define QUICKEN(quick_op) \
+  (op[-1] = reinterpret_cast<uintptr_t>(op_vtable[OP_##quick_op]))
+#define DEOPTIMISE(generic_op) \
+  (op[-1] = reinterpret_cast<uintptr_t>(op_vtable[OP_##generic_op]))
+#else
+#define QUICKEN(quick_op) (op[-1] = OP_##quick_op)
+#define DEOPTIMISE(generic_op) (op[-1] = OP_##generic_op)
+#endif
+
+#define NUM_OP(quick_op, generic_op, num_result, generic_result) \
+  CASE_OP(quick_op) {                                            \
+    v1 = TOPN(1);                                                \
+    v0 = TOP();                                                  \
+                                                                 \
+    if (likely(VARS_ARE_NUM(v1, v0))) {                          \
+      POP_AND_SWAP(num_result);                                  \
+    } else {                                                     \
+      DEOPTIMISE(generic_op);                                    \
+      POP_AND_SWAP(generic_result);                              \
+    }                                                            \
+                                                                 \
+    DISPATCH();                                                  \
+  }
+
+// the operands of typed ops are known to be numbers so are used as they are
+#define TYPED_OP(typed_op, result) \
+  CASE_OP(typed_op) {              \
+    v1 = TOPN(1);                  \
+    v0 = TOP();                    \
+    POP_AND_SWAP(result);          \
+                                   \
+    DISPATCH();                    \
+  }
+
+#define NN_ARITH(op) NUM_AS_VAR(VAR_AS_NUM(v1) op VAR_AS_NUM(v0))
+#define NN_COMPARE(op) as_var(VAR_AS_NUM(v1) op VAR_AS_NUM(v0))
+
+// push the result of an operator applied to two locals, the register pass
+// maps the operator token to the op itself and remove_skips then moves it to
+// the last operand byte, which is where errors raised here are looked up
+#define REG_OP(reg_op, result)      \
+  CASE_OP(reg_op) {                 \
+    v1 = GET(fp + OPERAND(op));     \
+    v0 = GET(fp + OPERAND(op + 2)); \
+    op += 4;                        \
+    PUSH(result);                   \
+                                    \
+    DISPATCH();                     \
+  }
+
+// store the result of an operator applied to two locals in a third local
+#define REG3_OP(reg_op, result)     \
+  CASE_OP(reg_op) {                 \
+    o0 = OPERAND(op);               \
+    v1 = GET(fp + OPERAND(op + 2)); \
+    v0 = GET(fp + OPERAND(op + 4)); \
+    op += 6;                        \
+    SET(fp + o0, result);           \
+                                    \
+    DISPATCH();                     \
+  }
+
+// compare a local with a constant or a second local and branch unless the
+// comparison holds, op is moved past the operands before comparing so that
+// errors map to the token the optimiser leaves on the last byte
+#define BRANCH_OP(branch_op, rhs, compare) \
+  CASE_OP(branch_op) {                     \
+    v1 = GET(fp + OPERAND(op));            \
+    v0 = rhs;                              \
+    op += 6;                               \
+    if (!(compare)) {                      \
+      op += OPERAND(op - 2) - 6;           \
+    }                                      \
+                                           \
+    DISPATCH();                            \
+  }
+
+// step a local and branch back to the body of a counted loop while the
+// comparison holds. Anything but numbers is stepped generically and then
+// left to the BRZ_ form entering the loop, which sits just before the body
+#define FORLOOP_OP(loop_op, rhs, step, step_fn, compare) \
+  CASE_OP(loop_op) {                                     \
+    o0 = OPERAND(op);                                    \
+    v1 = GET(fp + o0);                                   \
+    v0 = rhs;                                            \
+    op += 6;                                             \
+                                                         \
+    if (likely(VARS_ARE_NUM(v1, v0))) {                  \
+      v1 = NUM_AS_VAR(VAR_AS_NUM(v1) step 1.0);          \
+      SET(fp + o0, v1);                                  \
+      if (VAR_AS_NUM(v1) compare VAR_AS_NUM(v0)) {       \
+        op -= OPERAND(op - 2) + 6;                       \
+        GC_MAYBE();                                      \
+      }                                                  \
+    } else {                                             \
+      SET(fp + o0, step_fn(v1));                         \
+      op -= OPERAND(op - 2) + 6 + 7;                     \
+      GC_MAYBE();                                        \
+    }                                                    \
+                                                         \
+    DISPATCH();                                          \
+  }
+
+#define RK_OPERAND CONST_OPERAND(op + 2)
+#define RR_OPERAND GET(fp + OPERAND(op + 2))
+
+// the steps superinstructions are made of, each reads its operands at arg
+// and leaves arg at the operands of the next step
+#define STEP_SKIP(arg)
+#define STEP_GET(arg) PUSH(GET(fp + OPERAND(arg))), arg += 2;
+#define STEP_SET(arg) SET(fp + OPERAND(arg), TOP()), arg += 2;
+#define STEP_POP(arg) POP();
+#define STEP_NIL(arg) PUSH(nil);
+#define STEP_TRUE(arg) PUSH(yes);
+#define STEP_FALSE(arg) PUSH(no);
+#define STEP_ZERO(arg) PUSH(zero);
+#define STEP_ONE(arg) PUSH(one);
+#define STEP_TWO(arg) PUSH(two);
+#define STEP_CONST(arg) PUSH(CONST_OPERAND(arg)), arg += 2;
+#define STEP_GLOBAL(arg) PUSH(var(global_vars.get(OPERAND(arg)))), arg += 2;
+#define STEP_STORE(arg) global_vars.set(OPERAND(arg), TOP()), arg += 2;
+#define STEP_MOVE(arg) \
+  SET(fp + OPERAND(arg), GET(fp + OPERAND(arg + 2))), arg += 4;
+#define STEP_BINARY(result) \
+  v1 = TOPN(1), v0 = TOP(), POP_AND_SWAP(result);
+#define STEP_ADD(arg) STEP_BINARY(var_add(v1, v0))
+#define STEP_SUB(arg) STEP_BINARY(var_sub(v1, v0))
+#define STEP_MUL(arg) STEP_BINARY(var_mul(v1, v0))
+#define STEP_DIV(arg) STEP_BINARY(var_div(v1, v0))
+#define STEP_LT(arg) STEP_BINARY(as_var(var_lt(v1, v0)))
+#define STEP_LTEQ(arg) STEP_BINARY(as_var(var_lteq(v1, v0)))
+#define STEP_GT(arg) STEP_BINARY(as_var(var_gt(v1, v0)))
+#define STEP_GTEQ(arg) STEP_BINARY(as_var(var_gteq(v1, v0)))
+#define STEP_EQ(arg) STEP_BINARY(as_var(var_eq(v1, v0)))
+#define STEP_NEQ(arg) STEP_BINARY(as_var(var_neq(v1, v0)))
+#define STEP_INC(arg) TOP_SWAP(var_inc(TOP()));
+#define STEP_DEC(arg) TOP_SWAP(var_dec(TOP()));
+#define STEP_NEG(arg) TOP_SWAP(var_neg(TOP()));
+#define STEP_REG(arg, result)                                           \
+  v1 = GET(fp + OPERAND(arg)), v0 = GET(fp + OPERAND(arg + 2)), arg += 4, \
+  PUSH(result);
+#define STEP_ADD_RR(arg) STEP_REG(arg, var_add(v1, v0))
+#define STEP_SUB_RR(arg) STEP_REG(arg, var_sub(v1, v0))
+#define STEP_MUL_RR(arg) STEP_REG(arg, var_mul(v1, v0))
+#define STEP_DIV_RR(arg) STEP_REG(arg, var_div(v1, v0))
+#define STEP_LT_RR(arg) STEP_REG(arg, as_var(var_lt(v1, v0)))
+#define STEP_LTEQ_RR(arg) STEP_REG(arg, as_var(var_lteq(v1, v0)))
+#define STEP_GT_RR(arg) STEP_REG(arg, as_var(var_gt(v1, v0)))
+#define STEP_GTEQ_RR(arg) STEP_REG(arg, as_var(var_gteq(v1, v0)))
+#define STEP_EQ_RR(arg) STEP_REG(arg, as_var(var_eq(v1, v0)))
+#define STEP_NEQ_RR(arg) STEP_REG(arg, as_var(var_neq(v1, v0)))
+#define STEP_ADD_RK(arg)                                             \
+  v1 = GET(fp + OPERAND(arg)), v0 = CONST_OPERAND(arg + 2), arg += 4, \
+  PUSH(var_add(v1, v0));
+#define STEP_SUB_RK(arg)                                             \
+  v1 = GET(fp + OPERAND(arg)), v0 = CONST_OPERAND(arg + 2), arg += 4, \
+  PUSH(var_sub(v1, v0));
+#define STEP_INC_R(arg) \
+  o0 = OPERAND(arg), arg += 2, SET(fp + o0, var_inc(GET(fp + o0)));
+#define STEP_DEC_R(arg) \
+  o0 = OPERAND(arg), arg += 2, SET(fp + o0, var_dec(GET(fp + o0)));
+#define STEP_REG3(arg, result)                                         \
+  o0 = OPERAND(arg), v1 = GET(fp + OPERAND(arg + 2)),                  \
+  v0 = GET(fp + OPERAND(arg + 4)), arg += 6, SET(fp + o0, result);
+#define STEP_ADD_RRR(arg) STEP_REG3(arg, var_add(v1, v0))
+#define STEP_SUB_RRR(arg) STEP_REG3(arg, var_sub(v1, v0))
+#define STEP_MUL_RRR(arg) STEP_REG3(arg, var_mul(v1, v0))
+#define STEP_DIV_RRR(arg) STEP_REG3(arg, var_div(v1, v0))
+
+// run the steps of a superinstruction, op is first moved past all of the
+// operands so that errors map to the token the optimiser leaves there
+#define SUPER_OP(super_op, _, operand_bytes, first, second, third) \
+  CASE_OP(super_op) {                                              \
+    [[maybe_unused]] code_unit *arg = op;                          \
+    op += operand_bytes;                                           \
+    STEP_##first(arg) STEP_##second(arg) STEP_##third(arg)         \
+                                                                   \
+    DISPATCH();                                                    \
+  }
+
 namespace dwt {
 
+namespace {
+
+inline instance_obj *as_instance(var v) {
+  if (is_obj(v) && VAR_AS_OBJ(v)->type() == OBJ_INSTANCE) {
+    return static_cast<instance_obj *>(VAR_AS_OBJ(v));
+  }
+  return nullptr;
+}
+
+inline string_obj *as_string(var v) {
+  if (is_obj(v) && VAR_AS_OBJ(v)->type() == OBJ_STRING) {
+    return static_cast<string_obj *>(VAR_AS_OBJ(v));
+  }
+  return nullptr;
+}
+
+} // namespace
+
 interpreter::interpreter()
   : exec_stack(1024) {
 
@@ -187,6 +417,207 @@ closure_obj *interpreter::op_closure(uint32_t operand, size_t fp) {
   return closure;
 }
 
+/**
+ * Get a member of an object, refreshing the call site cache if the member
+ * resolves to a slot of an instance or to a method of its class.
+ *
+ * @param v The object.
+ * @param key The member name.
+ * @param cache The call site cache.
+ * @return The member value.
+ */
+var interpreter::op_mbrget(var v, var key, member_cache &cache) {
+  obj *o = as_obj(v);
+
+  if (o->type() == OBJ_INSTANCE) {
+    auto inst = static_cast<instance_obj *>(o);
+    int idx = inst->layout()->find(key);
+
+    if (idx >= 0) {
+      cache.layout = inst->layout();
+      cache.slot = idx;
+      cache.method = nil;
+      return inst->slot_at(idx);
+    }
+
+    // while the layout has room no string member can be in the dictionary
+    // so the layout alone decides that the class method is not shadowed
+    if (inst->layout()->size() < SHAPE_MAX_SLOTS) {
+      var method = inst->klass()->method(key);
+
+      if (method != nil) {
+        cache.layout = inst->layout();
+        cache.method = method;
+        return method;
+      }
+    }
+  }
+
+  return o->op_mbrget(key);
+}
+
+/**
+ * Set a member of an object, refreshing the call site cache if the member
+ * resolves to a slot of an instance.
+ *
+ * @param v The object.
+ * @param key The member name.
+ * @param value The new member value.
+ * @param cache The call site cache.
+ */
+void interpreter::op_mbrset(var v, var key, var value, member_cache &cache) {
+  obj *o = as_obj(v);
+
+  if (o->type() == OBJ_INSTANCE) {
+    auto inst = static_cast<instance_obj *>(o);
+    int idx = inst->layout()->find(key);
+
+    if (idx >= 0) {
+      cache.layout = inst->layout();
+      cache.slot = idx;
+      cache.method = nil;
+      inst->slot_at(idx) = value;
+      return;
+    }
+  }
+
+  o->op_mbrset(key, value);
+}
+
+/**
+ * Resolve the method of an object that is about to be invoked, adding the
+ * receiver's layout to the call site cache if the method resolves to a
+ * slot of an instance or to a method of its class.
+ *
+ * @param v The receiver.
+ * @param key The method name.
+ * @param nr_args The number of arguments passed at the call site.
+ * @param cache The call site cache.
+ * @return The method.
+ */
+var interpreter::op_invoke(var v,
+                           var key,
+                           unsigned int nr_args,
+                           invoke_cache &cache) {
+  obj *o = as_obj(v);
+
+  if (o->type() == OBJ_INSTANCE) {
+    auto inst = static_cast<instance_obj *>(o);
+    int idx = inst->layout()->find(key);
+
+    if (idx >= 0) {
+      auto &way = cache.replace();
+      way.layout = inst->layout();
+      way.slot = idx;
+      way.method = nil;
+      return inst->slot_at(idx);
+    }
+
+    if (inst->layout()->size() < SHAPE_MAX_SLOTS) {
+      var method = inst->klass()->method(key);
+
+      // only plain functions that accept the arguments at this call site
+      // can be invoked without dispatching on type
+      if (method != nil && VAR_AS_OBJ(method)->type() == OBJ_FUNCTION &&
+          static_cast<function_obj *>(VAR_AS_OBJ(method))->arity() ==
+            nr_args) {
+        auto &way = cache.replace();
+        way.layout = inst->layout();
+        way.method = method;
+        return method;
+      }
+    }
+  }
+
+  return o->op_mbrget(key);
+}
+
+/**
+ * Check that a function accepts the number of arguments it is called with,
+ * passing nil for any trailing arguments left out by the caller.
+ *
+ * @param fun_obj The function.
+ * @param nr_args The number of arguments.
+ * @return The number of arguments on the stack once padded.
+ */
+unsigned int interpreter::check_arity(function_obj *fun_obj,
+                                      unsigned int nr_args) {
+  if (unlikely(nr_args > fun_obj->arity())) {
+    throw interpret_exception("e@1 expected at most " +
+                              std::to_string(fun_obj->arity()) +
+                              " argument(s) but got " +
+                              std::to_string(nr_args));
+  }
+
+  while (nr_args < fun_obj->arity()) {
+    exec_stack.push(nil);
+    ++nr_args;
+  }
+
+  return nr_args;
+}
+
+/**
+ * Call an object, checking the number of arguments first if the object is
+ * a function.
+ *
+ * @param o The object to call.
+ * @param nr_args The number of arguments.
+ */
+void interpreter::op_call(obj *o, unsigned int nr_args) {
+  switch (o->type()) {
+  case OBJ_FUNCTION:
+  case OBJ_CLASS:
+    nr_args = check_arity(static_cast<function_obj *>(o), nr_args);
+    break;
+  case OBJ_CLOSURE:
+    nr_args = check_arity(static_cast<closure_obj *>(o)->fun_obj(), nr_args);
+    break;
+  default:
+    break;
+  }
+
+  o->call(*this, nr_args);
+}
+
+/**
+ * Call an object, refreshing the call site cache if the object is a plain
+ * function or a closure over one that takes exactly the arguments passed,
+ * or a syscall.
+ *
+ * @param v The object to call.
+ * @param nr_args The number of arguments.
+ * @param cache The call site cache.
+ */
+void interpreter::op_call(var v, unsigned int nr_args, call_cache &cache) {
+  obj *o = as_obj(v);
+  function_obj *fun_obj = nullptr;
+
+  switch (o->type()) {
+  case OBJ_FUNCTION:
+    fun_obj = static_cast<function_obj *>(o);
+    break;
+  case OBJ_CLOSURE:
+    fun_obj = static_cast<closure_obj *>(o)->fun_obj();
+    break;
+  case OBJ_SYSCALL:
+    cache.callee = v;
+    cache.kind = CALL_SYSCALL;
+    break;
+  default:
+    break;
+  }
+
+  // calls that need their arguments padded always take the slow path
+  if (fun_obj && fun_obj->type() == OBJ_FUNCTION &&
+      fun_obj->arity() == nr_args) {
+    cache.callee = v;
+    cache.kind = o->type() == OBJ_FUNCTION ? CALL_FUNCTION : CALL_CLOSURE;
+  }
+
+  op_call(o, nr_args);
+}
+
 #if 0
 void interpreter::dump_frame(std::stringstream &ss, frame &fr)
 {
@@ -266,38 +697,48 @@ void interpreter::dump_state(frame *frame, uint8_t *&op)
 
 #endif
 
-token_ref interpreter::get_op_token(function_obj *fun_obj, uint8_t *op_ptr) {
-  uintptr_t op_idx = op_ptr - fun_obj->code().entry();
+token_ref interpreter::get_op_token(function_obj *fun_obj, code_unit *op_ptr) {
+  uintptr_t op_idx = op_ptr - threaded_code::entry(fun_obj);
 
   return fun_obj->code().token_at(op_idx);
 }
 
 var interpreter::interpret(obj *callable_obj, var *args, size_t nr_args) {
-  PUSH(as_var(callable_obj));
+#include <dwt/interpreter.inc>
+
+#if THREADING_ENABLED
+  // functions called from here on are threaded with these handlers
+  threaded_code::handlers(op_vtable);
+#endif
+
+  exec_stack.push(as_var(callable_obj));
 
   for (size_t i = 0; i < nr_args; ++i) {
-    PUSH(args[i]);
+    exec_stack.push(args[i]);
   }
 
   callable_obj->call(*this, nr_args);
 
   if (callable_obj->type() == OBJ_SYSCALL) {
-    return TOP_AND_POP();
+    return exec_stack.top_and_pop();
   }
 
-  uint8_t *op = TOP_FRAME().ip;
+  code_unit *op = TOP_FRAME().ip;
   unsigned int fp = 0;
   unsigned int o0;
   var v0, v1;
+#if USE_TOS_CACHE
+  var tos, popped;
+#endif
   var one = as_var(1.0);
   var two = as_var(2.0);
   var zero = as_var(0.0);
   var yes = as_var(true);
   var no = as_var(false);
-  auto &consts = constants::table().get_all();
+  [[maybe_unused]] auto &consts = constants::table().get_all();
   auto &global_vars = globals::table().get_all();
 
-#include <dwt/interpreter.inc>
+  TOS_FILL();
 
   try {
 
@@ -341,9 +782,59 @@ var interpreter::interpret(obj *callable_obj, var *args, size_t nr_args) {
       }
 
       CASE_OP(CALL) {
-        v0 = TOPN(o0 = *op++);
+        auto &cache = TOP_FRAME().fn->code().call_cache_at(OPERAND(op));
+        v0 = TOPN(o0 = BYTE_OPERAND(op + 2));
+        op += 3;
         SAVE_STATE();
-        as_obj(v0)->call(*this, o0);
+
+        if (likely(v0 == cache.callee)) {
+          switch (cache.kind) {
+          case CALL_FUNCTION:
+#if JIT_ENABLED
+            if (jit::invoke(
+                  *this, static_cast<function_obj *>(VAR_AS_OBJ(v0)), o0)) {
+              break;
+            }
+#endif
+            invoke(static_cast<function_obj *>(VAR_AS_OBJ(v0)), o0);
+            break;
+          case CALL_CLOSURE: {
+            auto closure = static_cast<closure_obj *>(VAR_AS_OBJ(v0));
+            push_frame(call_frame(
+              closure->fun_obj(), closure, exec_stack.size() - (o0 + 1)));
+          } break;
+          case CALL_SYSCALL:
+            invoke(static_cast<syscall_obj *>(VAR_AS_OBJ(v0)), o0);
+            break;
+          }
+        } else {
+          op_call(v0, o0, cache);
+        }
+        LOAD_STATE();
+
+        GC_MAYBE();
+        DISPATCH();
+      }
+
+      CASE_OP(INVOKE) {
+        auto &cache = TOP_FRAME().fn->code().invoke_cache_at(OPERAND(op + 2));
+        auto inst = as_instance(TOPN(o0 = BYTE_OPERAND(op + 4)));
+        auto way = inst ? cache.find(inst->layout()) : nullptr;
+        op += 5;
+        SAVE_STATE();
+
+        if (likely(way && way->method != nil)) {
+          exec_stack.top_ref(o0) = way->method;
+          invoke(static_cast<function_obj *>(VAR_AS_OBJ(way->method)), o0);
+        } else {
+          if (way) {
+            v0 = inst->slot_at(way->slot);
+          } else {
+            v0 = op_invoke(TOPN(o0), CONST_OPERAND(op - 5), o0, cache);
+          }
+          exec_stack.top_ref(o0) = v0;
+          op_call(as_obj(v0), o0);
+        }
         LOAD_STATE();
 
         GC_MAYBE();
@@ -364,7 +855,7 @@ var interpreter::interpret(obj *callable_obj, var *args, size_t nr_args) {
           LOAD_STATE();
         } else {
           BUG_UNLESS(exec_stack.size() == 1);
-          return TOP_AND_POP();
+          return exec_stack.top_and_pop();
         }
 
         DISPATCH();
@@ -427,20 +918,24 @@ var interpreter::interpret(obj *callable_obj, var *args, size_t nr_args) {
       }
 
       CASE_OP(POPN) {
-        POPN(*op++);
+        POPN(BYTE_OPERAND(op++));
 
         DISPATCH();
       }
 
       CASE_OP(TAILCALL) {
-        v0 = TOPN(o0 = *op++);
+        auto &cache = TOP_FRAME().fn->code().call_cache_at(OPERAND(op));
+        v0 = TOPN(o0 = BYTE_OPERAND(op + 2));
+        op += 3;
+
         if (as_obj(v0) == TOP_FRAME().fn) {
+          o0 = check_arity(TOP_FRAME().fn, o0);
           exec_stack.squash(fp, o0);
-          op = TOP_FRAME().fn->code().entry();
+          TOS_FILL();
+          op = threaded_code::entry(TOP_FRAME().fn);
         } else {
           SAVE_STATE();
-          // definitely an object otherwise previous as_obj call would throw
-          VAR_AS_OBJ(v0)->call(*this, o0);
+          op_call(v0, o0, cache);
           LOAD_STATE();
         }
 
@@ -464,6 +959,7 @@ var interpreter::interpret(obj *callable_obj, var *args, size_t nr_args) {
 
       CASE_OP(CLOSE) {
         close_upvars(exec_stack.size() - 1);
+        POP();
 
         DISPATCH();
       }
@@ -487,20 +983,34 @@ var interpreter::interpret(obj *callable_obj, var *args, size_t nr_args) {
       }
 
       CASE_OP(MBRGET) {
-        v0 = consts.get(OPERAND(op));
-        v1 = TOP();
-        POP_AND_SWAP(as_obj(v1)->op_mbrget(v0));
-        op += 2;
+        auto &cache = TOP_FRAME().fn->code().member_cache_at(OPERAND(op + 2));
+        auto inst = as_instance(TOP());
+
+        if (likely(inst && inst->layout() == cache.layout)) {
+          if (cache.method == nil) {
+            TOP_SWAP(inst->slot_at(cache.slot));
+          } else {
+            TOP_SWAP(cache.method);
+          }
+        } else {
+          TOP_SWAP(op_mbrget(TOP(), CONST_OPERAND(op), cache));
+        }
+        op += 4;
 
         DISPATCH();
       }
 
       CASE_OP(MBRSET) {
-        v0 = consts.get(OPERAND(op));
-        v1 = TOPN(1);
-        as_obj(v1)->op_mbrset(v0, TOP());
-        op += 2;
-        POP();
+        auto &cache = TOP_FRAME().fn->code().member_cache_at(OPERAND(op + 2));
+        auto inst = as_instance(TOPN(1));
+
+        if (likely(inst && inst->layout() == cache.layout)) {
+          inst->slot_at(cache.slot) = TOP();
+        } else {
+          op_mbrset(TOPN(1), CONST_OPERAND(op), TOP(), cache);
+        }
+        POP_AND_SWAP(TOP());
+        op += 4;
 
         DISPATCH();
       }
@@ -517,7 +1027,7 @@ var interpreter::interpret(obj *callable_obj, var *args, size_t nr_args) {
         v1 = TOPN(2);
         v0 = TOPN(1);
         as_obj(v1)->op_keyset(v0, TOP());
-        POPN(3);
+        POPN_AND_SWAP(2, TOP());
 
         DISPATCH();
       }
@@ -546,7 +1056,7 @@ var interpreter::interpret(obj *callable_obj, var *args, size_t nr_args) {
       }
 
       CASE_OP(CONST) {
-        PUSH(var(consts.get(OPERAND(op))));
+        PUSH(CONST_OPERAND(op));
         op += 2;
 
         DISPATCH();
@@ -560,25 +1070,51 @@ var interpreter::interpret(obj *callable_obj, var *args, size_t nr_args) {
       }
 
       CASE_OP(ADD) {
-        POP_AND_SWAP(var_add(TOPN(1), TOP()));
+        v1 = TOPN(1);
+        v0 = TOP();
+
+        if (VARS_ARE_NUM(v1, v0)) {
+          QUICKEN(ADD_NUM);
+        } else if (as_string(v1) && as_string(v0)) {
+          QUICKEN(ADD_STR);
+        }
+        POP_AND_SWAP(var_add(v1, v0));
 
         DISPATCH();
       }
 
       CASE_OP(SUB) {
-        POP_AND_SWAP(var_sub(TOPN(1), TOP()));
+        v1 = TOPN(1);
+        v0 = TOP();
+
+        if (VARS_ARE_NUM(v1, v0)) {
+          QUICKEN(SUB_NUM);
+        }
+        POP_AND_SWAP(var_sub(v1, v0));
 
         DISPATCH();
       }
 
       CASE_OP(MUL) {
-        POP_AND_SWAP(var_mul(TOPN(1), TOP()));
+        v1 = TOPN(1);
+        v0 = TOP();
+
+        if (VARS_ARE_NUM(v1, v0)) {
+          QUICKEN(MUL_NUM);
+        }
+        POP_AND_SWAP(var_mul(v1, v0));
 
         DISPATCH();
       }
 
       CASE_OP(DIV) {
-        POP_AND_SWAP(var_div(TOPN(1), TOP()));
+        v1 = TOPN(1);
+        v0 = TOP();
+
+        if (VARS_ARE_NUM(v1, v0)) {
+          QUICKEN(DIV_NUM);
+        }
+        POP_AND_SWAP(var_div(v1, v0));
 
         DISPATCH();
       }
@@ -601,38 +1137,116 @@ var interpreter::interpret(obj *callable_obj, var *args, size_t nr_args) {
         DISPATCH();
       }
 
+      CASE_OP(MOD) {
+        POP_AND_SWAP(var_mod(TOPN(1), TOP()));
+
+        DISPATCH();
+      }
+
+      CASE_OP(SHL) {
+        POP_AND_SWAP(var_shl(TOPN(1), TOP()));
+
+        DISPATCH();
+      }
+
+      CASE_OP(SHR) {
+        POP_AND_SWAP(var_shr(TOPN(1), TOP()));
+
+        DISPATCH();
+      }
+
+      CASE_OP(BAND) {
+        POP_AND_SWAP(var_band(TOPN(1), TOP()));
+
+        DISPATCH();
+      }
+
+      CASE_OP(BOR) {
+        POP_AND_SWAP(var_bor(TOPN(1), TOP()));
+
+        DISPATCH();
+      }
+
+      CASE_OP(BXOR) {
+        POP_AND_SWAP(var_bxor(TOPN(1), TOP()));
+
+        DISPATCH();
+      }
+
+      CASE_OP(BNOT) {
+        TOP_SWAP(var_bnot(TOP()));
+
+        DISPATCH();
+      }
+
       CASE_OP(LT) {
-        POP_AND_SWAP(as_var(var_lt(TOPN(1), TOP())));
+        v1 = TOPN(1);
+        v0 = TOP();
+
+        if (VARS_ARE_NUM(v1, v0)) {
+          QUICKEN(LT_NUM);
+        }
+        POP_AND_SWAP(as_var(var_lt(v1, v0)));
 
         DISPATCH();
       }
 
       CASE_OP(LTEQ) {
-        POP_AND_SWAP(as_var(var_lteq(TOPN(1), TOP())));
+        v1 = TOPN(1);
+        v0 = TOP();
+
+        if (VARS_ARE_NUM(v1, v0)) {
+          QUICKEN(LTEQ_NUM);
+        }
+        POP_AND_SWAP(as_var(var_lteq(v1, v0)));
 
         DISPATCH();
       }
 
       CASE_OP(GT) {
-        POP_AND_SWAP(as_var(var_gt(TOPN(1), TOP())));
+        v1 = TOPN(1);
+        v0 = TOP();
+
+        if (VARS_ARE_NUM(v1, v0)) {
+          QUICKEN(GT_NUM);
+        }
+        POP_AND_SWAP(as_var(var_gt(v1, v0)));
 
         DISPATCH();
       }
 
       CASE_OP(GTEQ) {
-        POP_AND_SWAP(as_var(var_gteq(TOPN(1), TOP())));
+        v1 = TOPN(1);
+        v0 = TOP();
+
+        if (VARS_ARE_NUM(v1, v0)) {
+          QUICKEN(GTEQ_NUM);
+        }
+        POP_AND_SWAP(as_var(var_gteq(v1, v0)));
 
         DISPATCH();
       }
 
       CASE_OP(EQ) {
-        POP_AND_SWAP(as_var(var_eq(TOPN(1), TOP())));
+        v1 = TOPN(1);
+        v0 = TOP();
+
+        if (VARS_ARE_NUM(v1, v0)) {
+          QUICKEN(EQ_NUM);
+        }
+        POP_AND_SWAP(as_var(var_eq(v1, v0)));
 
         DISPATCH();
       }
 
       CASE_OP(NEQ) {
-        POP_AND_SWAP(as_var(var_neq(TOPN(1), TOP())));
+        v1 = TOPN(1);
+        v0 = TOP();
+
+        if (VARS_ARE_NUM(v1, v0)) {
+          QUICKEN(NEQ_NUM);
+        }
+        POP_AND_SWAP(as_var(var_neq(v1, v0)));
 
         DISPATCH();
       }
@@ -662,6 +1276,161 @@ var interpreter::interpret(obj *callable_obj, var *args, size_t nr_args) {
         DISPATCH();
       }
 
+      CASE_OP(CHECK_NUM) {
+        if (unlikely(!VAR_IS_NUM(TOP()))) {
+          throw interpret_exception("e@1 expected a number");
+        }
+
+        DISPATCH();
+      }
+
+      CASE_OP(CHECK_NUM_R) {
+        v0 = GET(fp + OPERAND(op));
+        op += 2;
+
+        if (unlikely(!VAR_IS_NUM(v0))) {
+          throw interpret_exception("e@1 expected a number");
+        }
+
+        DISPATCH();
+      }
+
+      CASE_OP(ADD_STR) {
+        auto s1 = as_string(TOPN(1));
+        auto s0 = as_string(TOP());
+
+        if (likely(s1 && s0)) {
+          POP_AND_SWAP(as_var(string_mgr::get().add(s1->text() + s0->text())));
+        } else {
+          DEOPTIMISE(ADD);
+          POP_AND_SWAP(var_add(TOPN(1), TOP()));
+        }
+
+        DISPATCH();
+      }
+
+      NUM_OP(ADD_NUM, ADD, NUM_AS_VAR(VAR_AS_NUM(v1) + VAR_AS_NUM(v0)),
+             var_add(v1, v0))
+      NUM_OP(SUB_NUM, SUB, NUM_AS_VAR(VAR_AS_NUM(v1) - VAR_AS_NUM(v0)),
+             var_sub(v1, v0))
+      NUM_OP(MUL_NUM, MUL, NUM_AS_VAR(VAR_AS_NUM(v1) * VAR_AS_NUM(v0)),
+             var_mul(v1, v0))
+      NUM_OP(DIV_NUM, DIV, NUM_AS_VAR(VAR_AS_NUM(v1) / VAR_AS_NUM(v0)),
+             var_div(v1, v0))
+      NUM_OP(LT_NUM, LT, as_var(VAR_AS_NUM(v1) < VAR_AS_NUM(v0)),
+             as_var(var_lt(v1, v0)))
+      NUM_OP(LTEQ_NUM, LTEQ, as_var(VAR_AS_NUM(v1) <= VAR_AS_NUM(v0)),
+             as_var(var_lteq(v1, v0)))
+      NUM_OP(GT_NUM, GT, as_var(VAR_AS_NUM(v1) > VAR_AS_NUM(v0)),
+             as_var(var_gt(v1, v0)))
+      NUM_OP(GTEQ_NUM, GTEQ, as_var(VAR_AS_NUM(v1) >= VAR_AS_NUM(v0)),
+             as_var(var_gteq(v1, v0)))
+      NUM_OP(EQ_NUM, EQ, as_var(num_var_eq(v1, v0)), as_var(var_eq(v1, v0)))
+      NUM_OP(NEQ_NUM, NEQ, as_var(!num_var_eq(v1, v0)),
+             as_var(var_neq(v1, v0)))
+
+      CASE_OP(MOVE) {
+        SET(fp + OPERAND(op), GET(fp + OPERAND(op + 2)));
+        op += 4;
+
+        DISPATCH();
+      }
+
+      REG_OP(ADD_RR, var_add(v1, v0))
+      REG_OP(SUB_RR, var_sub(v1, v0))
+      REG_OP(MUL_RR, var_mul(v1, v0))
+      REG_OP(DIV_RR, var_div(v1, v0))
+      REG_OP(LT_RR, as_var(var_lt(v1, v0)))
+      REG_OP(LTEQ_RR, as_var(var_lteq(v1, v0)))
+      REG_OP(GT_RR, as_var(var_gt(v1, v0)))
+      REG_OP(GTEQ_RR, as_var(var_gteq(v1, v0)))
+      REG_OP(EQ_RR, as_var(var_eq(v1, v0)))
+      REG_OP(NEQ_RR, as_var(var_neq(v1, v0)))
+      REG3_OP(ADD_RRR, var_add(v1, v0))
+      REG3_OP(SUB_RRR, var_sub(v1, v0))
+      REG3_OP(MUL_RRR, var_mul(v1, v0))
+      REG3_OP(DIV_RRR, var_div(v1, v0))
+
+      CASE_OP(ADD_RK) {
+        v1 = GET(fp + OPERAND(op));
+        v0 = CONST_OPERAND(op + 2);
+        op += 4;
+        PUSH(var_add(v1, v0));
+
+        DISPATCH();
+      }
+
+      CASE_OP(SUB_RK) {
+        v1 = GET(fp + OPERAND(op));
+        v0 = CONST_OPERAND(op + 2);
+        op += 4;
+        PUSH(var_sub(v1, v0));
+
+        DISPATCH();
+      }
+
+      CASE_OP(INC_R) {
+        o0 = OPERAND(op);
+        op += 2;
+        SET(fp + o0, var_inc(GET(fp + o0)));
+
+        DISPATCH();
+      }
+
+      CASE_OP(DEC_R) {
+        o0 = OPERAND(op);
+        op += 2;
+        SET(fp + o0, var_dec(GET(fp + o0)));
+
+        DISPATCH();
+      }
+
+      BRANCH_OP(BRZ_LT_RK, RK_OPERAND, var_lt(v1, v0))
+      BRANCH_OP(BRZ_LTEQ_RK, RK_OPERAND, var_lteq(v1, v0))
+      BRANCH_OP(BRZ_GT_RK, RK_OPERAND, var_gt(v1, v0))
+      BRANCH_OP(BRZ_GTEQ_RK, RK_OPERAND, var_gteq(v1, v0))
+      BRANCH_OP(BRZ_EQ_RK, RK_OPERAND, var_eq(v1, v0))
+      BRANCH_OP(BRZ_NEQ_RK, RK_OPERAND, var_neq(v1, v0))
+      BRANCH_OP(BRZ_LT_RR, RR_OPERAND, var_lt(v1, v0))
+      BRANCH_OP(BRZ_LTEQ_RR, RR_OPERAND, var_lteq(v1, v0))
+      BRANCH_OP(BRZ_GT_RR, RR_OPERAND, var_gt(v1, v0))
+      BRANCH_OP(BRZ_GTEQ_RR, RR_OPERAND, var_gteq(v1, v0))
+      BRANCH_OP(BRZ_EQ_RR, RR_OPERAND, var_eq(v1, v0))
+      BRANCH_OP(BRZ_NEQ_RR, RR_OPERAND, var_neq(v1, v0))
+      FORLOOP_OP(FORLOOP_LT_RK, RK_OPERAND, +, var_inc, <)
+      FORLOOP_OP(FORLOOP_LTEQ_RK, RK_OPERAND, +, var_inc, <=)
+      FORLOOP_OP(FORLOOP_GT_RK, RK_OPERAND, -, var_dec, >)
+      FORLOOP_OP(FORLOOP_GTEQ_RK, RK_OPERAND, -, var_dec, >=)
+      FORLOOP_OP(FORLOOP_LT_RR, RR_OPERAND, +, var_inc, <)
+      FORLOOP_OP(FORLOOP_LTEQ_RR, RR_OPERAND, +, var_inc, <=)
+      FORLOOP_OP(FORLOOP_GT_RR, RR_OPERAND, -, var_dec, >)
+      FORLOOP_OP(FORLOOP_GTEQ_RR, RR_OPERAND, -, var_dec, >=)
+
+      TYPED_OP(ADD_NN, NN_ARITH(+))
+      TYPED_OP(SUB_NN, NN_ARITH(-))
+      TYPED_OP(MUL_NN, NN_ARITH(*))
+      TYPED_OP(DIV_NN, NN_ARITH(/))
+      TYPED_OP(LT_NN, NN_COMPARE(<))
+      TYPED_OP(LTEQ_NN, NN_COMPARE(<=))
+      TYPED_OP(GT_NN, NN_COMPARE(>))
+      TYPED_OP(GTEQ_NN, NN_COMPARE(>=))
+      REG_OP(ADD_RR_NN, NN_ARITH(+))
+      REG_OP(SUB_RR_NN, NN_ARITH(-))
+      REG_OP(MUL_RR_NN, NN_ARITH(*))
+      REG_OP(DIV_RR_NN, NN_ARITH(/))
+      REG_OP(LT_RR_NN, NN_COMPARE(<))
+      REG_OP(LTEQ_RR_NN, NN_COMPARE(<=))
+      REG_OP(GT_RR_NN, NN_COMPARE(>))
+      REG_OP(GTEQ_RR_NN, NN_COMPARE(>=))
+      REG3_OP(ADD_RRR_NN, NN_ARITH(+))
+      REG3_OP(SUB_RRR_NN, NN_ARITH(-))
+      REG3_OP(MUL_RRR_NN, NN_ARITH(*))
+      REG3_OP(DIV_RRR_NN, NN_ARITH(/))
+
+#define SUPER(...) SUPER_OP(__VA_ARGS__)
+#include <dwt/superinstructions.inc>
+#undef SUPER
+
       CASE_OP(MAP) {
         PUSH(as_var(static_cast<map_obj *>(TOP_FRAME().map)));
 
@@ -30,6 +30,7 @@ namespace dwt {
 
 class interpreter {
   friend class function_obj;
+  friend class jit;
 
 public:
   explicit interpreter();
@@ -38,22 +39,22 @@ public:
   virtual ~interpreter();
 
   inline void invoke(function_obj *fun_obj, unsigned int num_args) {
-    call_stack.push(call_frame(fun_obj, exec_stack.size() - (num_args + 1)));
+    push_frame(call_frame(fun_obj, exec_stack.size() - (num_args + 1)));
   }
 
   inline void invoke(closure_obj *closure, unsigned int num_args) {
-    call_stack.push(call_frame(closure, exec_stack.size() - (num_args + 1)));
+    push_frame(call_frame(closure, exec_stack.size() - (num_args + 1)));
   }
 
   inline void invoke(class_obj *klass, unsigned int num_args) {
-    call_stack.push(call_frame(klass, exec_stack.size() - (num_args + 1)));
+    push_frame(call_frame(klass, exec_stack.size() - (num_args + 1)));
   }
 
   inline void invoke(instance_obj *inst_obj, unsigned int num_args) {
   }
 
   inline void invoke(mapfn_obj *mapfn, unsigned int nr_args) {
-    call_stack.push(call_frame(mapfn, exec_stack.size() - (nr_args + 1)));
+    push_frame(call_frame(mapfn, exec_stack.size() - (nr_args + 1)));
   }
 
   inline void invoke(syscall_obj *syscall, unsigned int num_args) {
@@ -85,10 +86,17 @@ public:
   }
 
 private:
+  // set aside the exec stack a frame can use, so that the values its ops
+  // push need no check
+  inline void push_frame(const call_frame &frame) {
+    exec_stack.reserve(exec_stack.size() + frame.fn->code().max_stack());
+    call_stack.push(frame);
+  }
+
   upvar_obj *capture_upvar(size_t, size_t);
   void close_upvars(size_t);
 
-  token_ref get_op_token(function_obj *fun_obj, uint8_t *op_ptr);
+  token_ref get_op_token(function_obj *fun_obj, code_unit *op_ptr);
   // void dump_frame(std::stringstream &, frame &);
   // void dump_state(frame *, uint8_t *&);
   std::string stack_trace();
@@ -97,6 +105,12 @@ private:
   void print(var);
 
   closure_obj *op_closure(uint32_t, size_t fp);
+  var op_mbrget(var, var, member_cache &);
+  void op_mbrset(var, var, var, member_cache &);
+  var op_invoke(var, var, unsigned int, invoke_cache &);
+  void op_call(obj *, unsigned int);
+  void op_call(var, unsigned int, call_cache &);
+  unsigned int check_arity(function_obj *, unsigned int);
 
   stack<call_frame> call_stack;
   stack<var> exec_stack;
@@ -36,11 +36,20 @@ public:
     return _api;
   }
 
+  void type(value_type type) {
+    _type = type;
+  }
+
+  value_type type() const {
+    return _type;
+  }
+
 private:
   size_t _index_of;
   bool _is_global;
   bool _is_constant;
   bool _api = false;
+  value_type _type = TYPE_ANY;
 };
 
 } // namespace ir
@@ -42,9 +42,24 @@ public:
     splice(std::move(block));
   }
 
+  value_type return_type() const {
+    return _return_type;
+  }
+
+  token_ref return_tok() const {
+    return _return_tok;
+  }
+
+  void return_type(value_type type, token_ref tok) {
+    _return_type = type;
+    _return_tok = tok;
+  }
+
 private:
   ir::parameters *_params = nullptr;
   ir::function_body *_body = nullptr;
+  value_type _return_type = TYPE_ANY;
+  token_ref _return_tok;
 };
 
 } // namespace ir
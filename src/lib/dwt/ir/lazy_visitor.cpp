@@ -10,6 +10,7 @@
 #include <dwt/ir/and_expr.hpp>
 #include <dwt/ir/arguments.hpp>
 #include <dwt/ir/assign_expr.hpp>
+#include <dwt/ir/bitwise_expr.hpp>
 #include <dwt/ir/block.hpp>
 #include <dwt/ir/boolean.hpp>
 #include <dwt/ir/break_stmt.hpp>
@@ -45,6 +46,7 @@
 #include <dwt/ir/return_stmt.hpp>
 #include <dwt/ir/scoped_name.hpp>
 #include <dwt/ir/script.hpp>
+#include <dwt/ir/shift_expr.hpp>
 #include <dwt/ir/string_spec.hpp>
 #include <dwt/ir/subscript_expr.hpp>
 #include <dwt/ir/super_expr.hpp>
@@ -292,6 +294,14 @@ void lazy_visitor::visit(ir::map_expr &decl) {
   visit(static_cast<ir::ast &>(decl));
 }
 
+void lazy_visitor::visit(ir::bitwise_expr &expr) {
+  visit(static_cast<ir::ast &>(expr));
+}
+
+void lazy_visitor::visit(ir::shift_expr &expr) {
+  visit(static_cast<ir::ast &>(expr));
+}
+
 void lazy_visitor::visit(ir::ast &decl) {
 }
 
@@ -76,6 +76,8 @@ public:
   virtual void visit(ir::break_stmt &) override;
   virtual void visit(ir::continue_stmt &) override;
   virtual void visit(ir::map_expr &) override;
+  virtual void visit(ir::bitwise_expr &) override;
+  virtual void visit(ir::shift_expr &) override;
 
   virtual void visit(ir::ast &) override;
 };
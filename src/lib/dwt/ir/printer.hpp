@@ -77,6 +77,8 @@ public:
   virtual void visit(ir::break_stmt &);
   virtual void visit(ir::continue_stmt &);
   virtual void visit(ir::map_expr &);
+  virtual void visit(ir::bitwise_expr &);
+  virtual void visit(ir::shift_expr &);
 
 private:
   void walk(ir::ast &);
@@ -72,6 +72,8 @@ class lambda;
 class break_stmt;
 class continue_stmt;
 class map_expr;
+class bitwise_expr;
+class shift_expr;
 
 class visitor {
 protected:
@@ -135,6 +137,8 @@ public:
   virtual void visit(ir::break_stmt &) = 0;
   virtual void visit(ir::continue_stmt &) = 0;
   virtual void visit(ir::map_expr &) = 0;
+  virtual void visit(ir::bitwise_expr &) = 0;
+  virtual void visit(ir::shift_expr &) = 0;
   virtual void visit(ir::ast &);
 };
 
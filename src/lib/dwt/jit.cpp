@@ -0,0 +1,1465 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#include <dwt/jit.hpp>
+
+#if JIT_ENABLED
+
+#include <dwt/constants.hpp>
+#include <dwt/exception.hpp>
+#include <dwt/garbage_collector.hpp>
+#include <dwt/globals.hpp>
+#include <dwt/interpret_exception.hpp>
+#include <dwt/interpreter.hpp>
+#include <dwt/opcode.hpp>
+#include <dwt/reporting.hpp>
+
+#include <cstddef>
+#include <sys/mman.h>
+#include <vector>
+
+namespace dwt {
+
+namespace {
+
+typedef var (*jit_entry)(jit_context *, size_t fp);
+
+struct jit_code {
+  jit_entry entry;
+  size_t size;
+  unsigned int max_depth;
+};
+
+enum reg {
+  RAX,
+  RCX,
+  RDX,
+  RBX,
+  RSP,
+  RBP,
+  RSI,
+  RDI,
+  R8,
+  R9,
+  R10,
+  R11,
+  R12,
+  R13,
+  R14,
+  R15,
+};
+
+enum cond {
+  CC_B = 0x2,
+  CC_BE = 0x6,
+  CC_E = 0x4,
+  CC_NE = 0x5,
+  CC_AE = 0x3,
+  CC_A = 0x7,
+  CC_P = 0xa,
+  CC_NP = 0xb,
+};
+
+// register conventions for generated code
+const reg FRAME = RBX; // address of the callee slot of the current frame
+const reg CTX = R12;   // the jit_context
+const reg FP = R13;    // byte offset of the frame in the exec stack
+
+/**
+ * A minimal x86-64 assembler covering the handful of instruction forms the
+ * code generator needs. Memory operands always use a 32 bit displacement.
+ */
+class assembler {
+public:
+  typedef size_t label;
+
+  label new_label() {
+    _labels.push_back(-1);
+    return _labels.size() - 1;
+  }
+
+  void bind(label l) {
+    _labels[l] = _buf.size();
+  }
+
+  void push(reg r) {
+    rex(false, 0, r);
+    byte(0x50 + (r & 7));
+  }
+
+  void pop(reg r) {
+    rex(false, 0, r);
+    byte(0x58 + (r & 7));
+  }
+
+  void mov(reg dst, reg src) {
+    rex(true, src, dst);
+    byte(0x89);
+    modrm(src, dst);
+  }
+
+  void mov(reg dst, uint64_t imm) {
+    rex(true, 0, dst);
+    byte(0xb8 + (dst & 7));
+    u64(imm);
+  }
+
+  void load(reg dst, reg base, int32_t disp) {
+    rex(true, dst, base);
+    byte(0x8b);
+    mem(dst, base, disp);
+  }
+
+  void store(reg base, int32_t disp, reg src) {
+    rex(true, src, base);
+    byte(0x89);
+    mem(src, base, disp);
+  }
+
+  void add(reg dst, reg src) {
+    alu(0x01, dst, src);
+  }
+
+  void andq(reg dst, reg src) {
+    alu(0x21, dst, src);
+  }
+
+  void xorq(reg dst, reg src) {
+    alu(0x31, dst, src);
+  }
+
+  void cmp(reg dst, reg src) {
+    alu(0x39, dst, src);
+  }
+
+  void test(reg dst, reg src) {
+    alu(0x85, dst, src);
+  }
+
+  // cmp byte [base + disp], imm
+  void cmpb(reg base, int32_t disp, uint8_t imm) {
+    rex(false, 0, base);
+    byte(0x80);
+    mem(7, base, disp);
+    byte(imm);
+  }
+
+  void movq_to_xmm(int xmm, reg src) {
+    byte(0x66);
+    rex(true, xmm, src);
+    byte(0x0f);
+    byte(0x6e);
+    modrm(xmm, src);
+  }
+
+  void movq_from_xmm(reg dst, int xmm) {
+    byte(0x66);
+    rex(true, xmm, dst);
+    byte(0x0f);
+    byte(0x7e);
+    modrm(xmm, dst);
+  }
+
+  // scalar double arithmetic on xmm0-xmm7, opc is one of 0x58 (addsd),
+  // 0x5c (subsd), 0x59 (mulsd) and 0x5e (divsd)
+  void sd(uint8_t opc, int dst, int src) {
+    byte(0xf2);
+    byte(0x0f);
+    byte(opc);
+    modrm(dst, src);
+  }
+
+  void ucomisd(int lhs, int rhs) {
+    byte(0x66);
+    byte(0x0f);
+    byte(0x2e);
+    modrm(lhs, rhs);
+  }
+
+  // set al or cl from a condition
+  void setcc(cond cc, reg r) {
+    byte(0x0f);
+    byte(0x90 | cc);
+    modrm(0, r);
+  }
+
+  void andb_al_cl() {
+    byte(0x20);
+    byte(0xc8);
+  }
+
+  void orb_al_cl() {
+    byte(0x08);
+    byte(0xc8);
+  }
+
+  void movzx_eax_al() {
+    byte(0x0f);
+    byte(0xb6);
+    byte(0xc0);
+  }
+
+  void jmp(label l) {
+    byte(0xe9);
+    fixup(l);
+  }
+
+  void jcc(cond cc, label l) {
+    byte(0x0f);
+    byte(0x80 | cc);
+    fixup(l);
+  }
+
+  void call(const void *fn) {
+    mov(RAX, reinterpret_cast<uint64_t>(fn));
+    byte(0xff);
+    byte(0xd0);
+  }
+
+  void ret() {
+    byte(0xc3);
+  }
+
+  // resolve jumps and copy the code into executable memory
+  jit_code *finish(unsigned int max_depth) {
+    for (auto &f : _fixups) {
+      int32_t rel = _labels[f.second] - (f.first + 4);
+      memcpy(&_buf[f.first], &rel, 4);
+    }
+
+    void *mem = mmap(nullptr,
+                     _buf.size(),
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS,
+                     -1,
+                     0);
+    if (mem == MAP_FAILED) {
+      return nullptr;
+    }
+
+    memcpy(mem, _buf.data(), _buf.size());
+    if (mprotect(mem, _buf.size(), PROT_READ | PROT_EXEC) != 0) {
+      munmap(mem, _buf.size());
+      return nullptr;
+    }
+
+    return new jit_code{ reinterpret_cast<jit_entry>(mem),
+                         _buf.size(),
+                         max_depth };
+  }
+
+private:
+  void byte(uint8_t b) {
+    _buf.push_back(b);
+  }
+
+  void u64(uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+      byte(v >> (i * 8));
+    }
+  }
+
+  void u32(uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+      byte(v >> (i * 8));
+    }
+  }
+
+  void rex(bool w, int r, int b) {
+    uint8_t prefix = 0x40 | (w << 3) | ((r >> 3) << 2) | (b >> 3);
+
+    if (prefix != 0x40) {
+      byte(prefix);
+    }
+  }
+
+  void modrm(int r, int rm) {
+    byte(0xc0 | ((r & 7) << 3) | (rm & 7));
+  }
+
+  void mem(int r, int base, int32_t disp) {
+    byte(0x80 | ((r & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) {
+      byte(0x24);
+    }
+    u32(disp);
+  }
+
+  void alu(uint8_t opc, reg dst, reg src) {
+    rex(true, src, dst);
+    byte(opc);
+    modrm(src, dst);
+  }
+
+  void fixup(label l) {
+    _fixups.emplace_back(_buf.size(), l);
+    u32(0);
+  }
+
+  std::vector<uint8_t> _buf;
+  std::vector<size_t> _labels;
+  std::vector<std::pair<size_t, label>> _fixups;
+};
+
+// helpers called from generated code, none of which may let an exception
+// escape since there is no unwind information for native frames
+template <typename Fn> var guard(jit_context *ctx, Fn fn) {
+  try {
+    return fn();
+  } catch (...) {
+    ctx->error = std::current_exception();
+    ctx->failed = true;
+    return nil;
+  }
+}
+
+#define BINARY_HELPER(name, expr)                       \
+  var name(jit_context *ctx, var v1, var v0) {          \
+    return guard(ctx, [&] { return var(expr); });       \
+  }
+
+#define UNARY_HELPER(name, expr)                        \
+  var name(jit_context *ctx, var v0) {                  \
+    return guard(ctx, [&] { return var(expr); });       \
+  }
+
+BINARY_HELPER(jit_add, var_add(v1, v0))
+BINARY_HELPER(jit_sub, var_sub(v1, v0))
+BINARY_HELPER(jit_mul, var_mul(v1, v0))
+BINARY_HELPER(jit_div, var_div(v1, v0))
+BINARY_HELPER(jit_lt, as_var(var_lt(v1, v0)))
+BINARY_HELPER(jit_lteq, as_var(var_lteq(v1, v0)))
+BINARY_HELPER(jit_gt, as_var(var_gt(v1, v0)))
+BINARY_HELPER(jit_gteq, as_var(var_gteq(v1, v0)))
+BINARY_HELPER(jit_eq, as_var(var_eq(v1, v0)))
+BINARY_HELPER(jit_neq, as_var(var_neq(v1, v0)))
+BINARY_HELPER(jit_is, as_var(var_is(v1, v0)))
+BINARY_HELPER(jit_and, as_var(!var_eqz(v1) && !var_eqz(v0)))
+BINARY_HELPER(jit_or, as_var(!var_eqz(v1) || !var_eqz(v0)))
+BINARY_HELPER(jit_xor, as_var(var_eqz(v1) != var_eqz(v0)))
+UNARY_HELPER(jit_inc, var_inc(v0))
+UNARY_HELPER(jit_dec, var_dec(v0))
+UNARY_HELPER(jit_neg, var_neg(v0))
+UNARY_HELPER(jit_bnot, var_bnot(v0))
+BINARY_HELPER(jit_mod, var_mod(v1, v0))
+BINARY_HELPER(jit_shl, var_shl(v1, v0))
+BINARY_HELPER(jit_shr, var_shr(v1, v0))
+BINARY_HELPER(jit_band, var_band(v1, v0))
+BINARY_HELPER(jit_bor, var_bor(v1, v0))
+BINARY_HELPER(jit_bxor, var_bxor(v1, v0))
+
+var jit_global(unsigned int idx) {
+  return globals::table().get(idx);
+}
+
+void jit_store(unsigned int idx, var v) {
+  globals::table().get_all().set(idx, v);
+}
+
+void jit_print(jit_context *ctx, var v, bool newline) {
+  guard(ctx, [&] {
+    jit::print(*ctx, v, newline);
+    return nil;
+  });
+}
+
+void jit_collect(jit_context *ctx, size_t fp, unsigned int depth) {
+  jit::collect(*ctx, fp / sizeof(var) + depth);
+}
+
+var jit_call(jit_context *ctx,
+             size_t fp,
+             unsigned int slot,
+             unsigned int nr_args) {
+  return guard(ctx, [&] {
+    return jit::call(*ctx, fp / sizeof(var) + slot, nr_args);
+  });
+}
+
+template <typename Fn> const void *address(Fn fn) {
+  return reinterpret_cast<const void *>(fn);
+}
+
+enum operand_kind {
+  NONE,
+  NUMBER, // inline fast path for numbers, helper otherwise
+  HELPER, // always calls the helper
+};
+
+struct binary_op {
+  operand_kind kind;
+  const void *helper;
+  uint8_t sd;     // addsd etc. for arithmetic
+  int compare;    // comparison to materialise, -1 for arithmetic
+};
+
+enum comparison { CMP_LT, CMP_LTEQ, CMP_GT, CMP_GTEQ, CMP_EQ, CMP_NEQ };
+
+binary_op binary_form(opcode op) {
+  switch (op) {
+  case OP_ADD:
+  case OP_ADD_NUM:
+  case OP_ADD_STR:
+  case OP_ADD_RR:
+  case OP_ADD_RRR:
+  case OP_ADD_NN:
+  case OP_ADD_RR_NN:
+  case OP_ADD_RRR_NN:
+  case OP_ADD_RK:
+    return { NUMBER, address(jit_add), 0x58, -1 };
+  case OP_SUB:
+  case OP_SUB_NUM:
+  case OP_SUB_RR:
+  case OP_SUB_RRR:
+  case OP_SUB_NN:
+  case OP_SUB_RR_NN:
+  case OP_SUB_RRR_NN:
+  case OP_SUB_RK:
+    return { NUMBER, address(jit_sub), 0x5c, -1 };
+  case OP_MUL:
+  case OP_MUL_NUM:
+  case OP_MUL_RR:
+  case OP_MUL_RRR:
+  case OP_MUL_NN:
+  case OP_MUL_RR_NN:
+  case OP_MUL_RRR_NN:
+    return { NUMBER, address(jit_mul), 0x59, -1 };
+  case OP_DIV:
+  case OP_DIV_NUM:
+  case OP_DIV_RR:
+  case OP_DIV_RRR:
+  case OP_DIV_NN:
+  case OP_DIV_RR_NN:
+  case OP_DIV_RRR_NN:
+    return { NUMBER, address(jit_div), 0x5e, -1 };
+  case OP_LT:
+  case OP_LT_NUM:
+  case OP_LT_RR:
+  case OP_LT_NN:
+  case OP_LT_RR_NN:
+  case OP_BRZ_LT_RK:
+  case OP_BRZ_LT_RR:
+  case OP_FORLOOP_LT_RK:
+  case OP_FORLOOP_LT_RR:
+    return { NUMBER, address(jit_lt), 0, CMP_LT };
+  case OP_LTEQ:
+  case OP_LTEQ_NUM:
+  case OP_LTEQ_RR:
+  case OP_LTEQ_NN:
+  case OP_LTEQ_RR_NN:
+  case OP_BRZ_LTEQ_RK:
+  case OP_BRZ_LTEQ_RR:
+  case OP_FORLOOP_LTEQ_RK:
+  case OP_FORLOOP_LTEQ_RR:
+    return { NUMBER, address(jit_lteq), 0, CMP_LTEQ };
+  case OP_GT:
+  case OP_GT_NUM:
+  case OP_GT_RR:
+  case OP_GT_NN:
+  case OP_GT_RR_NN:
+  case OP_BRZ_GT_RK:
+  case OP_BRZ_GT_RR:
+  case OP_FORLOOP_GT_RK:
+  case OP_FORLOOP_GT_RR:
+    return { NUMBER, address(jit_gt), 0, CMP_GT };
+  case OP_GTEQ:
+  case OP_GTEQ_NUM:
+  case OP_GTEQ_RR:
+  case OP_GTEQ_NN:
+  case OP_GTEQ_RR_NN:
+  case OP_BRZ_GTEQ_RK:
+  case OP_BRZ_GTEQ_RR:
+  case OP_FORLOOP_GTEQ_RK:
+  case OP_FORLOOP_GTEQ_RR:
+    return { NUMBER, address(jit_gteq), 0, CMP_GTEQ };
+  case OP_EQ:
+  case OP_EQ_NUM:
+  case OP_EQ_RR:
+  case OP_BRZ_EQ_RK:
+  case OP_BRZ_EQ_RR:
+    return { NUMBER, address(jit_eq), 0, CMP_EQ };
+  case OP_NEQ:
+  case OP_NEQ_NUM:
+  case OP_NEQ_RR:
+  case OP_BRZ_NEQ_RK:
+  case OP_BRZ_NEQ_RR:
+    return { NUMBER, address(jit_neq), 0, CMP_NEQ };
+  case OP_IS:
+    return { HELPER, address(jit_is), 0, -1 };
+  case OP_AND:
+    return { HELPER, address(jit_and), 0, -1 };
+  case OP_OR:
+    return { HELPER, address(jit_or), 0, -1 };
+  case OP_XOR:
+    return { HELPER, address(jit_xor), 0, -1 };
+  case OP_MOD:
+    return { HELPER, address(jit_mod), 0, -1 };
+  case OP_SHL:
+    return { HELPER, address(jit_shl), 0, -1 };
+  case OP_SHR:
+    return { HELPER, address(jit_shr), 0, -1 };
+  case OP_BAND:
+    return { HELPER, address(jit_band), 0, -1 };
+  case OP_BOR:
+    return { HELPER, address(jit_bor), 0, -1 };
+  case OP_BXOR:
+    return { HELPER, address(jit_bxor), 0, -1 };
+  default:
+    return { NONE, nullptr, 0, -1 };
+  }
+}
+
+inline int32_t slot(int n) {
+  return n * sizeof(var);
+}
+
+inline uint16_t operand(uint8_t *op) {
+  return op[0] | (op[1] << 8);
+}
+
+// an op, or one step of a superinstruction, with its operands
+struct step {
+  opcode op;
+  uint8_t *args;
+};
+
+/**
+ * Translates the bytecode of a function into native code, one template per
+ * opcode. Every stack slot lives at a fixed offset from the frame, since the
+ * depth of the stack at each op is known statically.
+ */
+class code_generator {
+public:
+  code_generator(function_obj *fn)
+    : _fn(fn)
+    , _code(fn->code().entry())
+    , _size(fn->code().size()) {
+  }
+
+  jit_code *generate() {
+    if (!analyse()) {
+      return nullptr;
+    }
+
+    prologue();
+
+    _at.resize(_size);
+    for (size_t pos = 0; pos < _size; ++pos) {
+      _at[pos] = _asm.new_label();
+    }
+    _bail = _asm.new_label();
+
+    for (size_t pos = 0; pos < _size;
+         pos += 1 + opcode_operand_bytes(_code[pos])) {
+      if (_depth[pos] >= 0) {
+        _asm.bind(_at[pos]);
+        emit(pos, _depth[pos]);
+      }
+    }
+
+    _asm.bind(_bail);
+    epilogue();
+
+    return _asm.finish(_max_depth);
+  }
+
+private:
+  // work out the stack depth at each op, rejecting functions that use
+  // opcodes without a template or whose depth is inconsistent at a join
+  bool analyse() {
+    _depth.assign(_size + 1, -1);
+    _depth[0] = _fn->arity() + 1;
+    _max_depth = _depth[0];
+    int d = -1;
+
+    for (size_t pos = 0; pos < _size;) {
+      opcode op = _code[pos];
+      size_t next = pos + 1 + opcode_operand_bytes(op);
+
+      if (_depth[pos] >= 0) {
+        if (d >= 0 && d != _depth[pos]) {
+          return false;
+        }
+        d = _depth[pos];
+      } else if (d < 0) {
+        pos = next;
+        continue;
+      } else {
+        _depth[pos] = d;
+      }
+
+      switch (op) {
+      case OP_BRA:
+        if (!join(pos + 1 + operand(&_code[pos + 1]), pos, d)) {
+          return false;
+        }
+        d = -1;
+        break;
+      case OP_LOOP:
+        if (!join(pos + 1 - operand(&_code[pos + 1]), pos, d)) {
+          return false;
+        }
+        d = -1;
+        break;
+      case OP_BRZ:
+      case OP_BNZ:
+        --d;
+        if (!join(pos + 1 + operand(&_code[pos + 1]), pos, d)) {
+          return false;
+        }
+        break;
+      case OP_BRZ_LT_RK:
+      case OP_BRZ_LTEQ_RK:
+      case OP_BRZ_GT_RK:
+      case OP_BRZ_GTEQ_RK:
+      case OP_BRZ_EQ_RK:
+      case OP_BRZ_NEQ_RK:
+        if (operand(&_code[pos + 1]) >= d ||
+            !join(pos + 1 + operand(&_code[pos + 5]), pos, d)) {
+          return false;
+        }
+        break;
+      case OP_BRZ_LT_RR:
+      case OP_BRZ_LTEQ_RR:
+      case OP_BRZ_GT_RR:
+      case OP_BRZ_GTEQ_RR:
+      case OP_BRZ_EQ_RR:
+      case OP_BRZ_NEQ_RR:
+        if (operand(&_code[pos + 1]) >= d || operand(&_code[pos + 3]) >= d ||
+            !join(pos + 1 + operand(&_code[pos + 5]), pos, d)) {
+          return false;
+        }
+        break;
+      case OP_FORLOOP_LT_RK:
+      case OP_FORLOOP_LTEQ_RK:
+      case OP_FORLOOP_GT_RK:
+      case OP_FORLOOP_GTEQ_RK:
+      case OP_FORLOOP_LT_RR:
+      case OP_FORLOOP_LTEQ_RR:
+      case OP_FORLOOP_GT_RR:
+      case OP_FORLOOP_GTEQ_RR: {
+        // branches back to the body or, for anything but numbers, to the
+        // test entering the loop just before it
+        size_t body = pos + 1 - operand(&_code[pos + 5]);
+        bool rr = _code[pos] >= OP_FORLOOP_LT_RR;
+        if (operand(&_code[pos + 1]) >= d ||
+            (rr && operand(&_code[pos + 3]) >= d) || body < 7 ||
+            !join(body, pos, d) || !join(body - 7, pos, d)) {
+          return false;
+        }
+      } break;
+      case OP_RET:
+        d = -1;
+        break;
+      case OP_POPN:
+        d -= _code[pos + 1];
+        break;
+      case OP_CALL:
+        d -= _code[pos + 3];
+        break;
+      default:
+        for (auto &step : steps(pos)) {
+          if (!step_depth(step, d)) {
+            return false;
+          }
+        }
+        break;
+      }
+
+      if (d >= 0) {
+        if (d < 1) {
+          return false;
+        }
+        _max_depth = std::max(_max_depth, static_cast<unsigned int>(d) + 1);
+      }
+      pos = next;
+    }
+
+    // code must not run off the end
+    return d < 0;
+  }
+
+  bool join(size_t target, size_t pos, int d) {
+    if (target >= _size) {
+      return false;
+    }
+    if (_depth[target] >= 0) {
+      return _depth[target] == d;
+    }
+    if (target <= pos) {
+      return false;
+    }
+    _depth[target] = d;
+    return true;
+  }
+
+  // check the locals a step addresses and apply its stack effect
+  bool step_depth(const step &step, int &d) {
+    switch (step.op) {
+    case OP_GET:
+    case OP_SET:
+    case OP_MOVE:
+    case OP_ADD_RR:
+    case OP_SUB_RR:
+    case OP_MUL_RR:
+    case OP_DIV_RR:
+    case OP_LT_RR:
+    case OP_LTEQ_RR:
+    case OP_GT_RR:
+    case OP_GTEQ_RR:
+    case OP_EQ_RR:
+    case OP_NEQ_RR:
+    case OP_ADD_RRR:
+    case OP_SUB_RRR:
+    case OP_MUL_RRR:
+    case OP_DIV_RRR:
+    case OP_ADD_RR_NN:
+    case OP_SUB_RR_NN:
+    case OP_MUL_RR_NN:
+    case OP_DIV_RR_NN:
+    case OP_LT_RR_NN:
+    case OP_LTEQ_RR_NN:
+    case OP_GT_RR_NN:
+    case OP_GTEQ_RR_NN:
+    case OP_ADD_RRR_NN:
+    case OP_SUB_RRR_NN:
+    case OP_MUL_RRR_NN:
+    case OP_DIV_RRR_NN:
+    case OP_INC_R:
+    case OP_DEC_R:
+      for (int i = 0; i < opcode_operand_bytes(step.op); i += 2) {
+        if (operand(step.args + i) >= d) {
+          return false;
+        }
+      }
+      break;
+    case OP_ADD_RK:
+    case OP_SUB_RK:
+      if (operand(step.args) >= d) {
+        return false;
+      }
+      break;
+    case OP_SKIP:
+    case OP_NIL:
+    case OP_TRUE:
+    case OP_FALSE:
+    case OP_ZERO:
+    case OP_ONE:
+    case OP_TWO:
+    case OP_POP:
+    case OP_GLOBAL:
+    case OP_CONST:
+    case OP_STORE:
+    case OP_INC:
+    case OP_DEC:
+    case OP_NEG:
+    case OP_BNOT:
+    case OP_PRINT:
+    case OP_PRINTLN:
+      break;
+    default:
+      if (binary_form(step.op).kind == NONE) {
+        return false;
+      }
+      break;
+    }
+
+    d += opcode_stack_effect(step.op);
+    if (d < 1) {
+      return false;
+    }
+    _max_depth = std::max(_max_depth, static_cast<unsigned int>(d) + 1);
+
+    return true;
+  }
+
+  // a superinstruction is compiled as the steps it is made of
+  std::vector<step> steps(size_t pos) {
+    uint8_t *args = &_code[pos + 1];
+
+    switch (_code[pos]) {
+#define SUPER(super_op, _, __, first, second, third) \
+  case OP_##super_op:                                \
+    return split(args, { OP_##first, OP_##second, OP_##third });
+#include <dwt/superinstructions.inc>
+#undef SUPER
+    default:
+      return { { _code[pos], args } };
+    }
+  }
+
+  static std::vector<step> split(uint8_t *args, std::vector<opcode> ops) {
+    std::vector<step> steps;
+
+    for (auto op : ops) {
+      if (op != OP_SKIP) {
+        steps.push_back({ op, args });
+        args += opcode_operand_bytes(op);
+      }
+    }
+
+    return steps;
+  }
+
+  void prologue() {
+    _asm.push(RBX);
+    _asm.push(R12);
+    _asm.push(R13);
+    _asm.mov(CTX, RDI);
+    _asm.mov(FP, RSI);
+    rebase();
+  }
+
+  void epilogue() {
+    _asm.pop(R13);
+    _asm.pop(R12);
+    _asm.pop(RBX);
+    _asm.ret();
+  }
+
+  // the exec stack may have moved during a call
+  void rebase() {
+    _asm.load(FRAME, CTX, offsetof(jit_state, bp));
+    _asm.add(FRAME, FP);
+  }
+
+  // record where to report an error raised by the next helper, errors are
+  // mapped to the last byte of an op since that is where the optimiser
+  // leaves the token
+  void locate(uint8_t *ip) {
+    _asm.mov(R11, reinterpret_cast<uint64_t>(_fn));
+    _asm.store(CTX, offsetof(jit_state, fn), R11);
+    _asm.mov(R11, reinterpret_cast<uint64_t>(ip));
+    _asm.store(CTX, offsetof(jit_state, ip), R11);
+  }
+
+  uint8_t *last_byte(size_t pos) {
+    return &_code[pos + opcode_operand_bytes(_code[pos])];
+  }
+
+  void check_failed() {
+    _asm.cmpb(CTX, offsetof(jit_state, failed), 0);
+    _asm.jcc(CC_NE, _bail);
+  }
+
+  void jump_unless_num(reg r, assembler::label l) {
+    _asm.mov(R8, r);
+    _asm.andq(R8, RDX);
+    _asm.cmp(R8, RDX);
+    _asm.jcc(CC_E, l);
+  }
+
+  void constant(int depth, var v) {
+    _asm.mov(RAX, v);
+    _asm.store(FRAME, slot(depth), RAX);
+  }
+
+  void binary(opcode op, uint8_t *ip, int lhs, int rhs, int dst) {
+    auto form = binary_form(op);
+    auto slow = _asm.new_label();
+    auto done = _asm.new_label();
+
+    _asm.load(RAX, FRAME, slot(lhs));
+    _asm.load(RCX, FRAME, slot(rhs));
+
+    if (form.kind == NUMBER) {
+      _asm.mov(RDX, QNAN);
+      jump_unless_num(RAX, slow);
+      jump_unless_num(RCX, slow);
+      _asm.movq_to_xmm(0, RAX);
+      _asm.movq_to_xmm(1, RCX);
+
+      switch (form.compare) {
+      case -1:
+        _asm.sd(form.sd, 0, 1);
+        _asm.movq_from_xmm(RAX, 0);
+        break;
+      case CMP_LT:
+        _asm.ucomisd(1, 0);
+        _asm.setcc(CC_A, RAX);
+        break;
+      case CMP_LTEQ:
+        _asm.ucomisd(1, 0);
+        _asm.setcc(CC_AE, RAX);
+        break;
+      case CMP_GT:
+        _asm.ucomisd(0, 1);
+        _asm.setcc(CC_A, RAX);
+        break;
+      case CMP_GTEQ:
+        _asm.ucomisd(0, 1);
+        _asm.setcc(CC_AE, RAX);
+        break;
+#if USE_STRICT_IEEE_754
+      case CMP_EQ:
+        _asm.ucomisd(0, 1);
+        _asm.setcc(CC_E, RAX);
+        _asm.setcc(CC_NP, RCX);
+        _asm.andb_al_cl();
+        break;
+      case CMP_NEQ:
+        _asm.ucomisd(0, 1);
+        _asm.setcc(CC_NE, RAX);
+        _asm.setcc(CC_P, RCX);
+        _asm.orb_al_cl();
+        break;
+#else
+      case CMP_EQ:
+        _asm.cmp(RAX, RCX);
+        _asm.setcc(CC_E, RAX);
+        break;
+      case CMP_NEQ:
+        _asm.cmp(RAX, RCX);
+        _asm.setcc(CC_NE, RAX);
+        break;
+#endif
+      }
+
+      if (form.compare >= 0) {
+        _asm.movzx_eax_al();
+        _asm.mov(RCX, VAR_FALSE);
+        _asm.add(RAX, RCX);
+      }
+      _asm.store(FRAME, slot(dst), RAX);
+      _asm.jmp(done);
+    }
+
+    _asm.bind(slow);
+    locate(ip);
+    _asm.mov(RDX, RCX);
+    _asm.mov(RSI, RAX);
+    _asm.mov(RDI, CTX);
+    _asm.call(form.helper);
+    check_failed();
+    _asm.store(FRAME, slot(dst), RAX);
+    _asm.bind(done);
+  }
+
+  void unary(uint8_t *ip, int n, const void *helper, uint8_t sd) {
+    auto slow = _asm.new_label();
+    auto done = _asm.new_label();
+
+    _asm.load(RAX, FRAME, slot(n));
+    _asm.mov(RDX, QNAN);
+    jump_unless_num(RAX, slow);
+    if (sd) {
+      _asm.movq_to_xmm(0, RAX);
+      _asm.mov(RCX, NUM_AS_VAR(1.0));
+      _asm.movq_to_xmm(1, RCX);
+      _asm.sd(sd, 0, 1);
+      _asm.movq_from_xmm(RAX, 0);
+    } else {
+      _asm.mov(RCX, SIGN_BIT);
+      _asm.xorq(RAX, RCX);
+    }
+    _asm.store(FRAME, slot(n), RAX);
+    _asm.jmp(done);
+
+    _asm.bind(slow);
+    locate(ip);
+    _asm.mov(RSI, RAX);
+    _asm.mov(RDI, CTX);
+    _asm.call(helper);
+    check_failed();
+    _asm.store(FRAME, slot(n), RAX);
+    _asm.bind(done);
+  }
+
+  // poll the collector on the way back to the top of a loop
+  void back_edge(assembler::label target, int depth) {
+    _asm.mov(RAX, reinterpret_cast<uint64_t>(&garbage_collector::is_waiting));
+    _asm.cmpb(RAX, 0, 0);
+    _asm.jcc(CC_E, target);
+    _asm.mov(RDI, CTX);
+    _asm.mov(RSI, FP);
+    _asm.mov(RDX, depth);
+    _asm.call(address(jit_collect));
+    _asm.jmp(target);
+  }
+
+  // step a counter and branch back to the body while the comparison with
+  // rhs holds, anything but numbers goes back through the entry test
+  void for_loop(
+      opcode op, uint8_t *ip, int counter, int rhs, int depth, size_t body) {
+    bool inc = op == OP_FORLOOP_LT_RK || op == OP_FORLOOP_LTEQ_RK ||
+               op == OP_FORLOOP_LT_RR || op == OP_FORLOOP_LTEQ_RR;
+    auto form = binary_form(op);
+    auto slow = _asm.new_label();
+    auto back = _asm.new_label();
+    auto done = _asm.new_label();
+
+    _asm.load(RAX, FRAME, slot(counter));
+    _asm.load(RCX, FRAME, slot(rhs));
+    _asm.mov(RDX, QNAN);
+    jump_unless_num(RAX, slow);
+    jump_unless_num(RCX, slow);
+    _asm.movq_to_xmm(0, RAX);
+    _asm.mov(RAX, NUM_AS_VAR(1.0));
+    _asm.movq_to_xmm(2, RAX);
+    _asm.sd(inc ? 0x58 : 0x5c, 0, 2);
+    _asm.movq_from_xmm(RAX, 0);
+    _asm.store(FRAME, slot(counter), RAX);
+    _asm.movq_to_xmm(1, RCX);
+
+    switch (form.compare) {
+    case CMP_LT:
+      _asm.ucomisd(1, 0);
+      _asm.jcc(CC_A, back);
+      break;
+    case CMP_LTEQ:
+      _asm.ucomisd(1, 0);
+      _asm.jcc(CC_AE, back);
+      break;
+    case CMP_GT:
+      _asm.ucomisd(0, 1);
+      _asm.jcc(CC_A, back);
+      break;
+    case CMP_GTEQ:
+      _asm.ucomisd(0, 1);
+      _asm.jcc(CC_AE, back);
+      break;
+    }
+    _asm.jmp(done);
+
+    _asm.bind(back);
+    back_edge(_at[body], depth);
+
+    _asm.bind(slow);
+    locate(ip);
+    _asm.mov(RSI, RAX);
+    _asm.mov(RDI, CTX);
+    _asm.call(address(inc ? jit_inc : jit_dec));
+    check_failed();
+    _asm.store(FRAME, slot(counter), RAX);
+    back_edge(_at[body - 7], depth);
+
+    _asm.bind(done);
+  }
+
+  // branch to target unless the comparison of two slots holds
+  void compare_branch(
+      opcode op, uint8_t *ip, int lhs, int rhs, assembler::label target) {
+    auto form = binary_form(op);
+    auto slow = _asm.new_label();
+    auto done = _asm.new_label();
+
+    _asm.load(RAX, FRAME, slot(lhs));
+    _asm.load(RCX, FRAME, slot(rhs));
+    _asm.mov(RDX, QNAN);
+    jump_unless_num(RAX, slow);
+    jump_unless_num(RCX, slow);
+    _asm.movq_to_xmm(0, RAX);
+    _asm.movq_to_xmm(1, RCX);
+
+    // an unordered comparison sets ZF, PF and CF so NaNs take the branch
+    switch (form.compare) {
+    case CMP_LT:
+      _asm.ucomisd(1, 0);
+      _asm.jcc(CC_BE, target);
+      break;
+    case CMP_LTEQ:
+      _asm.ucomisd(1, 0);
+      _asm.jcc(CC_B, target);
+      break;
+    case CMP_GT:
+      _asm.ucomisd(0, 1);
+      _asm.jcc(CC_BE, target);
+      break;
+    case CMP_GTEQ:
+      _asm.ucomisd(0, 1);
+      _asm.jcc(CC_B, target);
+      break;
+#if USE_STRICT_IEEE_754
+    case CMP_EQ:
+      _asm.ucomisd(0, 1);
+      _asm.jcc(CC_NE, target);
+      _asm.jcc(CC_P, target);
+      break;
+    case CMP_NEQ:
+      _asm.ucomisd(0, 1);
+      _asm.jcc(CC_P, done);
+      _asm.jcc(CC_E, target);
+      break;
+#else
+    case CMP_EQ:
+      _asm.cmp(RAX, RCX);
+      _asm.jcc(CC_NE, target);
+      break;
+    case CMP_NEQ:
+      _asm.cmp(RAX, RCX);
+      _asm.jcc(CC_E, target);
+      break;
+#endif
+    }
+    _asm.jmp(done);
+
+    _asm.bind(slow);
+    locate(ip);
+    _asm.mov(RDX, RCX);
+    _asm.mov(RSI, RAX);
+    _asm.mov(RDI, CTX);
+    _asm.call(form.helper);
+    check_failed();
+    _asm.mov(RCX, VAR_TRUE);
+    _asm.cmp(RAX, RCX);
+    _asm.jcc(CC_NE, target);
+    _asm.bind(done);
+  }
+
+  // a value is zero if it is the number 0, false or nil
+  void branch(int depth, bool if_zero, assembler::label target) {
+    auto skip = _asm.new_label();
+    auto zero = if_zero ? target : skip;
+
+    _asm.load(RAX, FRAME, slot(depth - 1));
+    _asm.test(RAX, RAX);
+    _asm.jcc(CC_E, zero);
+    _asm.mov(RCX, VAR_FALSE);
+    _asm.cmp(RAX, RCX);
+    _asm.jcc(CC_E, zero);
+    _asm.mov(RCX, nil);
+    _asm.cmp(RAX, RCX);
+    _asm.jcc(CC_E, zero);
+    if (!if_zero) {
+      _asm.jmp(target);
+    }
+    _asm.bind(skip);
+  }
+
+  void emit(size_t pos, int depth) {
+    uint8_t *op = &_code[pos + 1];
+
+    switch (_code[pos]) {
+    case OP_POPN:
+      break;
+    case OP_BRA:
+      _asm.jmp(_at[pos + 1 + operand(op)]);
+      break;
+    case OP_BRZ:
+      branch(depth, true, _at[pos + 1 + operand(op)]);
+      break;
+    case OP_BNZ:
+      branch(depth, false, _at[pos + 1 + operand(op)]);
+      break;
+    case OP_LOOP:
+      back_edge(_at[pos + 1 - operand(op)], depth);
+      break;
+    case OP_CALL: {
+      unsigned int nr_args = op[2];
+      unsigned int callee = depth - (nr_args + 1);
+      locate(last_byte(pos));
+      _asm.mov(RDI, CTX);
+      _asm.mov(RSI, FP);
+      _asm.mov(RDX, callee);
+      _asm.mov(RCX, nr_args);
+      _asm.call(address(jit_call));
+      check_failed();
+      rebase();
+      _asm.store(FRAME, slot(callee), RAX);
+    } break;
+    case OP_RET:
+      _asm.load(RAX, FRAME, slot(depth - 1));
+      epilogue();
+      break;
+    case OP_BRZ_LT_RK:
+    case OP_BRZ_LTEQ_RK:
+    case OP_BRZ_GT_RK:
+    case OP_BRZ_GTEQ_RK:
+    case OP_BRZ_EQ_RK:
+    case OP_BRZ_NEQ_RK:
+      // the constant goes in the free slot above the stack
+      constant(depth, constants::table().get_all().get(operand(op + 2)));
+      compare_branch(_code[pos],
+                     last_byte(pos),
+                     operand(op),
+                     depth,
+                     _at[pos + 1 + operand(op + 4)]);
+      break;
+    case OP_BRZ_LT_RR:
+    case OP_BRZ_LTEQ_RR:
+    case OP_BRZ_GT_RR:
+    case OP_BRZ_GTEQ_RR:
+    case OP_BRZ_EQ_RR:
+    case OP_BRZ_NEQ_RR:
+      compare_branch(_code[pos],
+                     last_byte(pos),
+                     operand(op),
+                     operand(op + 2),
+                     _at[pos + 1 + operand(op + 4)]);
+      break;
+    case OP_FORLOOP_LT_RK:
+    case OP_FORLOOP_LTEQ_RK:
+    case OP_FORLOOP_GT_RK:
+    case OP_FORLOOP_GTEQ_RK:
+      constant(depth, constants::table().get_all().get(operand(op + 2)));
+      for_loop(_code[pos], last_byte(pos), operand(op), depth, depth,
+               pos + 1 - operand(op + 4));
+      break;
+    case OP_FORLOOP_LT_RR:
+    case OP_FORLOOP_LTEQ_RR:
+    case OP_FORLOOP_GT_RR:
+    case OP_FORLOOP_GTEQ_RR:
+      for_loop(_code[pos], last_byte(pos), operand(op), operand(op + 2), depth,
+               pos + 1 - operand(op + 4));
+      break;
+    default:
+      for (auto &step : steps(pos)) {
+        emit_step(step, depth, last_byte(pos));
+        depth += opcode_stack_effect(step.op);
+      }
+      break;
+    }
+  }
+
+  void emit_step(const step &step, int depth, uint8_t *ip) {
+    uint8_t *op = step.args;
+
+    switch (step.op) {
+    case OP_SKIP:
+    case OP_POP:
+      break;
+    case OP_NIL:
+      constant(depth, nil);
+      break;
+    case OP_TRUE:
+      constant(depth, VAR_TRUE);
+      break;
+    case OP_FALSE:
+      constant(depth, VAR_FALSE);
+      break;
+    case OP_ZERO:
+      constant(depth, NUM_AS_VAR(0.0));
+      break;
+    case OP_ONE:
+      constant(depth, NUM_AS_VAR(1.0));
+      break;
+    case OP_TWO:
+      constant(depth, NUM_AS_VAR(2.0));
+      break;
+    case OP_CONST:
+      constant(depth, constants::table().get_all().get(operand(op)));
+      break;
+    case OP_GET:
+      _asm.load(RAX, FRAME, slot(operand(op)));
+      _asm.store(FRAME, slot(depth), RAX);
+      break;
+    case OP_SET:
+      _asm.load(RAX, FRAME, slot(depth - 1));
+      _asm.store(FRAME, slot(operand(op)), RAX);
+      break;
+    case OP_MOVE:
+      _asm.load(RAX, FRAME, slot(operand(op + 2)));
+      _asm.store(FRAME, slot(operand(op)), RAX);
+      break;
+    case OP_GLOBAL:
+      _asm.mov(RDI, operand(op));
+      _asm.call(address(jit_global));
+      _asm.store(FRAME, slot(depth), RAX);
+      break;
+    case OP_STORE:
+      _asm.mov(RDI, operand(op));
+      _asm.load(RSI, FRAME, slot(depth - 1));
+      _asm.call(address(jit_store));
+      break;
+    case OP_INC:
+      unary(ip, depth - 1, address(jit_inc), 0x58);
+      break;
+    case OP_DEC:
+      unary(ip, depth - 1, address(jit_dec), 0x5c);
+      break;
+    case OP_NEG:
+      unary(ip, depth - 1, address(jit_neg), 0);
+      break;
+    case OP_BNOT:
+      unary(ip, depth - 1, address(jit_bnot), 0);
+      break;
+    case OP_INC_R:
+      unary(ip, operand(op), address(jit_inc), 0x58);
+      break;
+    case OP_DEC_R:
+      unary(ip, operand(op), address(jit_dec), 0x5c);
+      break;
+    case OP_PRINT:
+    case OP_PRINTLN:
+      locate(ip);
+      _asm.mov(RDI, CTX);
+      _asm.load(RSI, FRAME, slot(depth - 1));
+      _asm.mov(RDX, step.op == OP_PRINTLN);
+      _asm.call(address(jit_print));
+      check_failed();
+      break;
+    case OP_ADD_RR:
+    case OP_SUB_RR:
+    case OP_MUL_RR:
+    case OP_DIV_RR:
+    case OP_LT_RR:
+    case OP_LTEQ_RR:
+    case OP_GT_RR:
+    case OP_GTEQ_RR:
+    case OP_EQ_RR:
+    case OP_NEQ_RR:
+    case OP_ADD_RR_NN:
+    case OP_SUB_RR_NN:
+    case OP_MUL_RR_NN:
+    case OP_DIV_RR_NN:
+    case OP_LT_RR_NN:
+    case OP_LTEQ_RR_NN:
+    case OP_GT_RR_NN:
+    case OP_GTEQ_RR_NN:
+      binary(step.op, ip, operand(op), operand(op + 2), depth);
+      break;
+    case OP_ADD_RRR:
+    case OP_SUB_RRR:
+    case OP_MUL_RRR:
+    case OP_DIV_RRR:
+    case OP_ADD_RRR_NN:
+    case OP_SUB_RRR_NN:
+    case OP_MUL_RRR_NN:
+    case OP_DIV_RRR_NN:
+      binary(step.op, ip, operand(op + 2), operand(op + 4), operand(op));
+      break;
+    case OP_ADD_RK:
+    case OP_SUB_RK:
+      constant(depth, constants::table().get_all().get(operand(op + 2)));
+      binary(step.op, ip, operand(op), depth, depth);
+      break;
+    default:
+      binary(step.op, ip, depth - 2, depth - 1, depth - 2);
+      break;
+    }
+  }
+
+  function_obj *_fn;
+  uint8_t *_code;
+  size_t _size;
+  std::vector<int> _depth;
+  std::vector<assembler::label> _at;
+  assembler::label _bail;
+  unsigned int _max_depth;
+  assembler _asm;
+};
+
+} // namespace
+
+unsigned int jit::depth = 0;
+
+/**
+ * Run a function natively if it has been compiled or has just become hot,
+ * leaving its result in place of the callee on the exec stack as a RET
+ * would.
+ *
+ * @param vm The interpreter making the call.
+ * @param fn The function, called with exactly its arity in arguments.
+ * @param nr_args The number of arguments on the stack.
+ * @return True if the call was made, false to interpret it instead.
+ */
+bool jit::invoke(interpreter &vm, function_obj *fn, unsigned int nr_args) {
+  if (!is_hot(fn) || depth >= JIT_MAX_DEPTH) {
+    return false;
+  }
+
+  unsigned int callee_pos = vm.exec_stack.size() - (nr_args + 1);
+  jit_context ctx(vm);
+  var result = enter(ctx, fn, callee_pos);
+
+  if (ctx.failed) {
+    try {
+      std::rethrow_exception(ctx.error);
+    } catch (interpret_exception &e) {
+      oops(e.what(), ctx.fn->code().token_at(ctx.ip - ctx.fn->code().entry()));
+    }
+  }
+
+  vm.exec_stack.truncate(callee_pos);
+  vm.exec_stack.push(result);
+
+  return true;
+}
+
+void jit::release(function_obj *fn) {
+  auto code = static_cast<jit_code *>(fn->jit_code());
+
+  if (code) {
+    munmap(reinterpret_cast<void *>(code->entry), code->size);
+    delete code;
+    fn->jit_code(nullptr);
+  }
+}
+
+/**
+ * Make a call from native code. Hot functions taking exactly their arity
+ * recurse natively, anything else runs on a nested interpreter.
+ *
+ * @param ctx The context of the calling native code.
+ * @param callee_pos The position of the callee on the exec stack.
+ * @param nr_args The number of arguments following the callee.
+ * @return The result of the call.
+ */
+var jit::call(jit_context &ctx, unsigned int callee_pos, unsigned int nr_args) {
+  auto &stack = ctx.vm.exec_stack;
+  stack.truncate(callee_pos + nr_args + 1);
+
+  obj *o = as_obj(stack.get(callee_pos));
+
+  if (o->type() == OBJ_FUNCTION) {
+    auto fn = static_cast<function_obj *>(o);
+
+    if (fn->arity() == nr_args && depth < JIT_MAX_DEPTH && is_hot(fn)) {
+      return enter(ctx, fn, callee_pos);
+    }
+  }
+
+  if (!ctx.nested) {
+    ctx.nested.reset(new interpreter);
+  }
+
+  return ctx.nested->interpret(o, stack.base() + callee_pos + 1, nr_args);
+}
+
+void jit::collect(jit_context &ctx, unsigned int sp) {
+  ctx.vm.exec_stack.truncate(sp);
+  garbage_collector::get().collect_garbage();
+}
+
+void jit::print(jit_context &ctx, var v, bool newline) {
+  if (newline) {
+    ctx.vm.println(v);
+  } else {
+    ctx.vm.print(v);
+  }
+}
+
+bool jit::compile(function_obj *fn) {
+  if (fn->type() != OBJ_FUNCTION || !fn->upvars().empty()) {
+    return false;
+  }
+
+  fn->jit_code(code_generator(fn).generate());
+
+  return fn->jit_code();
+}
+
+var jit::enter(jit_context &ctx, function_obj *fn, unsigned int callee_pos) {
+  auto code = static_cast<jit_code *>(fn->jit_code());
+  auto &stack = ctx.vm.exec_stack;
+
+  stack.reserve(callee_pos + code->max_depth);
+  ctx.bp = stack.base();
+
+  ++depth;
+  var result = code->entry(&ctx, callee_pos * sizeof(var));
+  --depth;
+
+  ctx.bp = stack.base();
+
+  return result;
+}
+
+} // namespace dwt
+
+#endif
@@ -0,0 +1,81 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#ifndef GUARD_DWT_JIT_HPP
+#define GUARD_DWT_JIT_HPP
+
+#if USE_JIT && defined(__x86_64__) && defined(__linux__)
+#define JIT_ENABLED 1
+#else
+#define JIT_ENABLED 0
+#endif
+
+#if JIT_ENABLED
+
+#include <dwt/function_obj.hpp>
+#include <dwt/var.hpp>
+
+#include <exception>
+#include <memory>
+
+// calls made through a call site cache before a function is compiled
+#define JIT_THRESHOLD 1000
+// native frames allowed on the C stack before calls fall back to bytecode
+#define JIT_MAX_DEPTH 1024
+
+namespace dwt {
+
+class interpreter;
+
+// the part of the context read and written by native code
+struct jit_state {
+  var *bp;          // base of the exec stack, reloaded after calls
+  function_obj *fn; // function and op to report if a helper fails
+  uint8_t *ip;
+  bool failed;
+};
+
+struct jit_context : jit_state {
+  jit_context(interpreter &vm)
+    : jit_state{ nullptr, nullptr, nullptr, false }
+    , vm(vm) {
+  }
+
+  interpreter &vm;
+  std::exception_ptr error;
+  std::unique_ptr<interpreter> nested; // runs callees that are not native
+};
+
+class jit {
+public:
+  static bool invoke(interpreter &, function_obj *, unsigned int nr_args);
+  static void release(function_obj *);
+
+  static var call(jit_context &, unsigned int callee_pos, unsigned int nr_args);
+  static void collect(jit_context &, unsigned int sp);
+  static void print(jit_context &, var v, bool newline);
+
+private:
+  static bool is_hot(function_obj *fn) {
+    if (fn->jit_code()) {
+      return true;
+    }
+    return ++fn->hotness() == JIT_THRESHOLD && compile(fn);
+  }
+
+  static bool compile(function_obj *);
+  static var enter(jit_context &, function_obj *, unsigned int callee_pos);
+
+  static unsigned int depth;
+};
+
+} // namespace dwt
+
+#endif
+
+#endif
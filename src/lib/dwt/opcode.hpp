@@ -17,6 +17,7 @@ enum opcodes : uint8_t {
 #define OP(op, _, __) OP_##op,
 #include <dwt/opcodes.inc>
 #undef OP
+  NR_OPCODES
 };
 
 typedef uint8_t opcode;
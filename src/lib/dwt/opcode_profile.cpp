@@ -0,0 +1,51 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#include <dwt/opcode_profile.hpp>
+
+#if USE_OPCODE_PROFILE
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace dwt {
+
+opcode_profile::opcode_profile()
+  : _prev{ NR_OPCODES, NR_OPCODES }
+  , _counts(OPCODE_SLOTS * OPCODE_SLOTS * OPCODE_SLOTS) {
+}
+
+opcode_profile::~opcode_profile() {
+  const char *path = getenv("DWT_OPCODE_PROFILE");
+  FILE *file = fopen(path ? path : "opcode.profile", "a");
+
+  if (!file) {
+    return;
+  }
+
+  auto name = [](unsigned int op) {
+    return op == NR_OPCODES ? "-" : decode(op);
+  };
+
+  for (size_t i = 0; i < _counts.size(); ++i) {
+    if (_counts[i]) {
+      fprintf(file,
+              "%llu %s %s %s\n",
+              static_cast<unsigned long long>(_counts[i]),
+              name(i / (OPCODE_SLOTS * OPCODE_SLOTS)),
+              name(i / OPCODE_SLOTS % OPCODE_SLOTS),
+              name(i % OPCODE_SLOTS));
+    }
+  }
+
+  fclose(file);
+}
+
+} // namespace dwt
+
+#endif
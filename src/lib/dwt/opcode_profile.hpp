@@ -0,0 +1,56 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#ifndef GUARD_DWT_OPCODE_PROFILE_HPP
+#define GUARD_DWT_OPCODE_PROFILE_HPP
+
+#if USE_OPCODE_PROFILE
+
+#include <dwt/opcode.hpp>
+#include <dwt/uncopyable.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace dwt {
+
+/**
+ * Counts the sequences of three opcodes dispatched by the interpreter, which
+ * are appended to the file named by DWT_OPCODE_PROFILE (opcode.profile by
+ * default) on exit for tools/superinstructions.py to read.
+ */
+class opcode_profile : public uncopyable {
+public:
+  static opcode_profile &get() {
+    static opcode_profile instance;
+    return instance;
+  }
+
+  inline opcode record(opcode op) {
+    ++_counts[(_prev[0] * OPCODE_SLOTS + _prev[1]) * OPCODE_SLOTS + op];
+    _prev[0] = _prev[1];
+    _prev[1] = op;
+    return op;
+  }
+
+private:
+  // every opcode plus a slot for no opcode at the start of a run
+  static const unsigned int OPCODE_SLOTS = NR_OPCODES + 1;
+
+  opcode_profile();
+  virtual ~opcode_profile();
+
+  unsigned int _prev[2];
+  std::vector<uint64_t> _counts;
+};
+
+} // namespace dwt
+
+#endif
+
+#endif
@@ -446,6 +446,11 @@ std::unique_ptr<function> parser::parse_function() {
     expect(TOK_RPAREN);
   }
 
+  if (peek(TOK_COLON)) {
+    auto type = parse_type();
+    fun->return_type(type, gettok());
+  }
+
   fun->body(parse_function_body());
 
   scope::close();
@@ -498,11 +503,12 @@ std::unique_ptr<parameters> parser::parse_parameters() {
     }
     accept(KW_VAR);
     expect(TOK_IDENT);
-    auto identifier = gettok();
     auto param = std::make_unique<parameter>(gettok());
+    auto ident = scope::add(gettok(), SCOPE_EXCLUSIVE | SCOPE_CREATE);
+    param->type(parse_type());
+    ident->type(param->type());
     params->splice(std::move(param));
     skip_any(TOK_BREAK);
-    scope::add(identifier, SCOPE_EXCLUSIVE | SCOPE_CREATE);
   } while (accept(TOK_COMMA));
 
   skip_any(TOK_BREAK);
@@ -510,6 +516,29 @@ std::unique_ptr<parameters> parser::parse_parameters() {
   return params;
 }
 
+/**
+ * Parse an optional type annotation, such as the ": num" of "var x: num".
+ *
+ * @return The annotated type, or TYPE_ANY without an annotation.
+ */
+value_type parser::parse_type() {
+  if (!accept(TOK_COLON)) {
+    return TYPE_ANY;
+  }
+
+  skip_any(TOK_BREAK);
+
+  if (!accept(TOK_IDENT)) {
+    oops("e@1 unknown type '$1'", _this_token);
+  }
+
+  if (gettok().text() != "num") {
+    oops("e@1 unknown type '$1'", gettok());
+  }
+
+  return TYPE_NUM;
+}
+
 /**
  * Parse a scoped block.
  *
@@ -618,7 +647,9 @@ std::unique_ptr<var_decl> parser::parse_var_decl() {
   expect(TOK_IDENT);
 
   auto decl = std::make_unique<var_decl>(gettok());
-  scope::add(gettok(), SCOPE_EXCLUSIVE | SCOPE_CREATE);
+  auto ident = scope::add(gettok(), SCOPE_EXCLUSIVE | SCOPE_CREATE);
+  decl->type(parse_type());
+  ident->type(decl->type());
 
   if (accept(TOK_ASSIGN)) {
     skip_any(TOK_BREAK);
@@ -1152,15 +1183,103 @@ std::unique_ptr<expr> parser::parse_compare_expr() {
     if (e) {
       t = gettok();
       skip_any(TOK_BREAK);
-      e = std::make_unique<compare_expr>(std::move(e), parse_add_expr(), t);
+      e = std::make_unique<compare_expr>(std::move(e), parse_bitor_expr(), t);
     } else {
-      e = parse_add_expr();
+      e = parse_bitor_expr();
     }
   } while (accept_any(TOK_GT, TOK_GT_EQ, TOK_LT, TOK_LT_EQ));
 
   return e;
 }
 
+/**
+ * Parse a bitwise "or" expression.
+ *
+ * @return The expression AST.
+ */
+std::unique_ptr<expr> parser::parse_bitor_expr() {
+  std::unique_ptr<expr> e;
+  token_ref t;
+
+  do {
+    if (e) {
+      t = gettok();
+      skip_any(TOK_BREAK);
+      e = std::make_unique<bitwise_expr>(std::move(e), parse_bitxor_expr(), t);
+    } else {
+      e = parse_bitxor_expr();
+    }
+  } while (accept(TOK_OR));
+
+  return e;
+}
+
+/**
+ * Parse a bitwise "xor" expression.
+ *
+ * @return The expression AST.
+ */
+std::unique_ptr<expr> parser::parse_bitxor_expr() {
+  std::unique_ptr<expr> e;
+  token_ref t;
+
+  do {
+    if (e) {
+      t = gettok();
+      skip_any(TOK_BREAK);
+      e = std::make_unique<bitwise_expr>(std::move(e), parse_bitand_expr(), t);
+    } else {
+      e = parse_bitand_expr();
+    }
+  } while (accept(TOK_XOR));
+
+  return e;
+}
+
+/**
+ * Parse a bitwise "and" expression.
+ *
+ * @return The expression AST.
+ */
+std::unique_ptr<expr> parser::parse_bitand_expr() {
+  std::unique_ptr<expr> e;
+  token_ref t;
+
+  do {
+    if (e) {
+      t = gettok();
+      skip_any(TOK_BREAK);
+      e = std::make_unique<bitwise_expr>(std::move(e), parse_shift_expr(), t);
+    } else {
+      e = parse_shift_expr();
+    }
+  } while (accept(TOK_AND));
+
+  return e;
+}
+
+/**
+ * Parse a shift expression.
+ *
+ * @return The expression AST.
+ */
+std::unique_ptr<expr> parser::parse_shift_expr() {
+  std::unique_ptr<expr> e;
+  token_ref t;
+
+  do {
+    if (e) {
+      t = gettok();
+      skip_any(TOK_BREAK);
+      e = std::make_unique<shift_expr>(std::move(e), parse_add_expr(), t);
+    } else {
+      e = parse_add_expr();
+    }
+  } while (accept_any(TOK_LSHIFT, TOK_RSHIFT));
+
+  return e;
+}
+
 /**
  * Parse an "add" expression.
  *
@@ -1200,7 +1319,7 @@ std::unique_ptr<expr> parser::parse_mult_expr() {
     } else {
       e = parse_unary_expr();
     }
-  } while (accept_any(TOK_FWDSLASH, TOK_STAR));
+  } while (accept_any(TOK_FWDSLASH, TOK_STAR, TOK_MODULO));
 
   return e;
 }
@@ -1211,7 +1330,7 @@ std::unique_ptr<expr> parser::parse_mult_expr() {
  * @return The expression AST.
  */
 std::unique_ptr<expr> parser::parse_unary_expr() {
-  if (accept_any(TOK_BANG, TOK_MINUS, TOK_PLUS)) {
+  if (accept_any(TOK_BANG, TOK_MINUS, TOK_PLUS, TOK_TILDE)) {
     auto t = gettok();
     skip_any(TOK_BREAK);
     return std::make_unique<unary_expr>(parse_unary_expr(), t);
@@ -13,6 +13,7 @@
 #include <dwt/ir/and_expr.hpp>
 #include <dwt/ir/arguments.hpp>
 #include <dwt/ir/assign_expr.hpp>
+#include <dwt/ir/bitwise_expr.hpp>
 #include <dwt/ir/block.hpp>
 #include <dwt/ir/boolean.hpp>
 #include <dwt/ir/break_stmt.hpp>
@@ -52,6 +53,7 @@
 #include <dwt/ir/return_stmt.hpp>
 #include <dwt/ir/scoped_name.hpp>
 #include <dwt/ir/script.hpp>
+#include <dwt/ir/shift_expr.hpp>
 #include <dwt/ir/stmt.hpp>
 #include <dwt/ir/subscript_expr.hpp>
 #include <dwt/ir/super_expr.hpp>
@@ -183,6 +185,7 @@ private:
   std::unique_ptr<ir::lambda_expr> parse_lambda_expr();
   std::unique_ptr<ir::lambda> parse_lambda();
   std::unique_ptr<ir::parameters> parse_parameters();
+  value_type parse_type();
   std::unique_ptr<ir::kv_pair> parse_kv_pair(size_t idx);
   std::unique_ptr<ir::block> parse_block();
   std::unique_ptr<ir::function_body> parse_function_body();
@@ -207,6 +210,10 @@ private:
   std::unique_ptr<ir::expr> parse_equality_expr();
   std::unique_ptr<ir::expr> parse_is_expr();
   std::unique_ptr<ir::expr> parse_compare_expr();
+  std::unique_ptr<ir::expr> parse_bitor_expr();
+  std::unique_ptr<ir::expr> parse_bitxor_expr();
+  std::unique_ptr<ir::expr> parse_bitand_expr();
+  std::unique_ptr<ir::expr> parse_shift_expr();
   std::unique_ptr<ir::expr> parse_add_expr();
   std::unique_ptr<ir::expr> parse_mult_expr();
   std::unique_ptr<ir::expr> parse_unary_expr();
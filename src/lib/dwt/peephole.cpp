@@ -15,7 +15,8 @@ namespace dwt {
 
 peephole::peephole(std::vector<ph_pattern> patterns)
   : _patterns(patterns)
-  , _off(0) {
+  , _off(0)
+  , _start(0) {
 }
 
 peephole::~peephole() {
@@ -56,6 +57,40 @@ bool peephole::jumps_into_range(code_obj &code, size_t off, size_t extent) {
         return true;
       }
       break;
+    case OP_BRZ_LT_RK:
+    case OP_BRZ_LTEQ_RK:
+    case OP_BRZ_GT_RK:
+    case OP_BRZ_GTEQ_RK:
+    case OP_BRZ_EQ_RK:
+    case OP_BRZ_NEQ_RK:
+    case OP_BRZ_LT_RR:
+    case OP_BRZ_LTEQ_RR:
+    case OP_BRZ_GT_RR:
+    case OP_BRZ_GTEQ_RR:
+    case OP_BRZ_EQ_RR:
+    case OP_BRZ_NEQ_RR:
+      // the branch follows the two operands being compared, a loop test
+      // branches to just after the back edge so the exact target is used
+      jmpoff = OPERAND(&ops[pos + 5]);
+      jmpoff += pos + 1;
+      if (jmpoff > off && jmpoff < (off + extent)) {
+        return true;
+      }
+      break;
+    case OP_FORLOOP_LT_RK:
+    case OP_FORLOOP_LTEQ_RK:
+    case OP_FORLOOP_GT_RK:
+    case OP_FORLOOP_GTEQ_RK:
+    case OP_FORLOOP_LT_RR:
+    case OP_FORLOOP_LTEQ_RR:
+    case OP_FORLOOP_GT_RR:
+    case OP_FORLOOP_GTEQ_RR:
+      jmpoff = OPERAND(&ops[pos + 5]);
+      jmpoff = (pos + 1) - jmpoff;
+      if ((jmpoff > off) && jmpoff < (off + extent)) {
+        return true;
+      }
+      break;
     default:
       break;
     }
@@ -71,8 +106,10 @@ void peephole::operator()(code_obj &code) {
   for (size_t i = 0; i < _patterns.size(); ++i) {
     _off = 0;
     while (scan(ops, i)) {
-      size_t off = _off - _patterns[i].extent;
-      if (!jumps_into_range(code, off, _patterns[i].extent)) {
+      size_t off = _start;
+      // a match spanning skips is not laid out the way most passes expect
+      if ((_off - off == size_t(_patterns[i].extent) || spans_skips()) &&
+          !jumps_into_range(code, off, _off - off)) {
         peep(&ops[off], code.size() - off);
       }
     }
@@ -86,10 +123,16 @@ bool peephole::scan(std::vector<uint8_t> &code, int idx) {
   while (seqoff < _patterns[idx].ops.size() && _off < code.size()) {
     if (code[_off] == _patterns[idx].ops[seqoff]) {
       uint8_t *op = &code[_off];
+      if (seqoff == 0) {
+        _start = _off;
+      }
       _off += 1 + opcode_operand_bytes(*op);
       ++seqoff;
     } else if (code[_off] == OP_SKIP) {
       ++_off;
+    } else if (seqoff > 0) {
+      // a partial match may be followed by the start of a full one
+      seqoff = 0;
     } else {
       _off += 1 + opcode_operand_bytes(code[_off]);
       seqoff = 0;
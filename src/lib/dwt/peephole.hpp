@@ -28,12 +28,18 @@ protected:
   void operator()(code_obj &code);
   bool jumps_into_range(code_obj &code, size_t off, size_t extent);
 
+  // whether peep() can handle a match with skips between its ops
+  virtual bool spans_skips() const {
+    return false;
+  }
+
 private:
   virtual void peep(uint8_t *op, size_t extent) = 0;
   bool scan(std::vector<uint8_t> &code, int idx);
 
   std::vector<ph_pattern> _patterns;
   size_t _off;
+  size_t _start;
 };
 
 } // namespace dwt
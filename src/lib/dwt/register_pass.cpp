@@ -0,0 +1,128 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#include <dwt/register_pass.hpp>
+
+namespace dwt {
+
+namespace {
+
+struct register_form {
+  opcode stack_op;
+  opcode two_addr_op;   // pushes the result of two locals
+  opcode three_addr_op; // stores the result of two locals in a third
+};
+
+const register_form forms[] = {
+  { OP_ADD, OP_ADD_RR, OP_ADD_RRR },   { OP_SUB, OP_SUB_RR, OP_SUB_RRR },
+  { OP_MUL, OP_MUL_RR, OP_MUL_RRR },   { OP_DIV, OP_DIV_RR, OP_DIV_RRR },
+  { OP_LT, OP_LT_RR, OP_SKIP },        { OP_LTEQ, OP_LTEQ_RR, OP_SKIP },
+  { OP_GT, OP_GT_RR, OP_SKIP },        { OP_GTEQ, OP_GTEQ_RR, OP_SKIP },
+  { OP_EQ, OP_EQ_RR, OP_SKIP },        { OP_NEQ, OP_NEQ_RR, OP_SKIP },
+  { OP_ADD_NN, OP_ADD_RR_NN, OP_ADD_RRR_NN },
+  { OP_SUB_NN, OP_SUB_RR_NN, OP_SUB_RRR_NN },
+  { OP_MUL_NN, OP_MUL_RR_NN, OP_MUL_RRR_NN },
+  { OP_DIV_NN, OP_DIV_RR_NN, OP_DIV_RRR_NN },
+  { OP_LT_NN, OP_LT_RR_NN, OP_SKIP },
+  { OP_LTEQ_NN, OP_LTEQ_RR_NN, OP_SKIP },
+  { OP_GT_NN, OP_GT_RR_NN, OP_SKIP },
+  { OP_GTEQ_NN, OP_GTEQ_RR_NN, OP_SKIP },
+};
+
+std::vector<ph_pattern> patterns() {
+  std::vector<ph_pattern> patterns;
+
+  for (auto &form : forms) {
+    patterns.push_back({ { OP_GET, OP_GET, form.stack_op }, 7 });
+  }
+  patterns.push_back({ { OP_GET, OP_SET, OP_POP }, 7 });
+
+  return patterns;
+}
+
+const register_form *find_form(opcode op) {
+  for (auto &form : forms) {
+    if (form.stack_op == op) {
+      return &form;
+    }
+  }
+
+  return nullptr;
+}
+
+} // namespace
+
+/**
+ * Rewrite sequences that only move values between locals of the current
+ * frame into register forms that address those locals directly, so that
+ * "a := b + c" dispatches a single ADD_RRR rather than GET, GET, ADD, SET
+ * and POP.
+ *
+ * @param code The code object to optimise.
+ */
+register_pass::register_pass(code_obj &code)
+  : peephole(patterns())
+  , _code(code) {
+
+  (*this)(code);
+}
+
+register_pass::~register_pass() {
+}
+
+void register_pass::peep(uint8_t *op, size_t extent) {
+  size_t off = op - _code.entry();
+
+  if (op[3] == OP_SET && op[6] == OP_POP) {
+    uint8_t src[2] = { op[1], op[2] };
+
+    op[0] = OP_MOVE;
+    op[1] = op[4];
+    op[2] = op[5];
+    op[3] = src[0];
+    op[4] = src[1];
+    op[5] = OP_SKIP;
+    op[6] = OP_SKIP;
+    return;
+  }
+
+  auto form = op[3] == OP_GET ? find_form(op[6]) : nullptr;
+
+  if (!form) {
+    return;
+  }
+
+  // errors raised by the operator still map to the operator token, kept on
+  // the first byte of the fused op until remove_skips moves it to the last
+  _code.token_at(off, _code.token_at(off + 6));
+
+  if (form->three_addr_op != OP_SKIP && extent >= 11 && op[7] == OP_SET &&
+      op[10] == OP_POP && !jumps_into_range(_code, off, 11)) {
+    uint8_t lhs[2] = { op[1], op[2] };
+    uint8_t rhs[2] = { op[4], op[5] };
+
+    op[0] = form->three_addr_op;
+    op[1] = op[8];
+    op[2] = op[9];
+    op[3] = lhs[0];
+    op[4] = lhs[1];
+    op[5] = rhs[0];
+    op[6] = rhs[1];
+    for (size_t i = 7; i < 11; ++i) {
+      op[i] = OP_SKIP;
+    }
+  } else {
+    op[0] = form->two_addr_op;
+    op[3] = op[4];
+    op[4] = op[5];
+    op[5] = OP_SKIP;
+    op[6] = OP_SKIP;
+  }
+}
+
+} // namespace dwt
@@ -17,6 +17,9 @@
 
 namespace dwt {
 
+// the type an identifier was annotated with, TYPE_ANY when it was not
+enum value_type { TYPE_ANY, TYPE_NUM };
+
 enum scope_flags {
   SCOPE_APPEND = 1 << 0,
   SCOPE_CREATE = 1 << 1,
@@ -47,6 +50,14 @@ public:
   bool is_global() const;
   int32_t lookup() const;
 
+  void type(value_type type) {
+    _type = type;
+  }
+
+  value_type type() const {
+    return _type;
+  }
+
   std::string name() const;
   std::string qualified_name() const;
   scope *find_scope(std::string) const;
@@ -63,6 +74,7 @@ private:
   token_ref _name_ref;
   int32_t _index;
   uint64_t _id;
+  value_type _type = TYPE_ANY;
 };
 
 } // namespace dwt
@@ -0,0 +1,144 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#include <dwt/shape.hpp>
+
+namespace dwt {
+
+shape *shape::_roots = nullptr;
+std::vector<shape *> shape::_retired_roots;
+
+shape::shape()
+  : _parent(nullptr)
+  , _root(this)
+  , _key(nil)
+  , _nr_slots(0)
+  , _prev(nullptr)
+  , _next(_roots)
+  , _refs(0)
+  , _retired(false) {
+
+  if (_roots) {
+    _roots->_prev = this;
+  }
+  _roots = this;
+}
+
+shape::shape(shape *parent, var key)
+  : _parent(parent)
+  , _root(parent->_root)
+  , _key(key)
+  , _nr_slots(parent->_nr_slots + 1)
+  , _prev(nullptr)
+  , _next(nullptr)
+  , _refs(0)
+  , _retired(false) {
+
+  parent->_offsets.for_all([this](auto entry) { _offsets.add(*entry); });
+  _offsets.add(kv_pair(key, NUM_AS_VAR(_nr_slots - 1)));
+}
+
+shape::~shape() {
+  for (auto &transition : _transitions) {
+    delete transition.second;
+  }
+}
+
+/**
+ * Create a new empty shape from which a family of layouts can be derived.
+ *
+ * @return The root shape.
+ */
+shape *shape::make_root() {
+  return new shape();
+}
+
+/**
+ * Find or create the shape reached by adding a member to this shape.
+ *
+ * @param key The member name.
+ * @return The derived shape, or nullptr if no more slots can be added.
+ */
+shape *shape::add(var key) {
+  for (auto &transition : _transitions) {
+    if (transition.first == key) {
+      return transition.second;
+    }
+  }
+
+  if (_nr_slots >= SHAPE_MAX_SLOTS) {
+    return nullptr;
+  }
+
+  shape *derived = new shape(this, key);
+  _transitions.emplace_back(key, derived);
+
+  return derived;
+}
+
+/**
+ * Find the slot offset of a member.
+ *
+ * @param key The member name.
+ * @return The slot offset, or -1 if the member is not part of this shape.
+ */
+int shape::find(var key) const {
+  auto kv = _offsets.get(key);
+
+  if (kv) {
+    return VAR_AS_NUM(kv->value);
+  }
+
+  return -1;
+}
+
+/**
+ * Take a reference to the family of shapes this shape belongs to, held by
+ * each class and instance using one of them.
+ */
+void shape::acquire() {
+  ++_root->_refs;
+}
+
+/**
+ * Drop a reference taken by acquire(). The last one retires the family, it
+ * is freed by free_retired() once no call site cache can refer to it.
+ */
+void shape::release() {
+  shape *root = _root;
+
+  if (--root->_refs > 0) {
+    return;
+  }
+
+  if (root->_prev) {
+    root->_prev->_next = root->_next;
+  }
+  if (root->_next) {
+    root->_next->_prev = root->_prev;
+  }
+  if (_roots == root) {
+    _roots = root->_next;
+  }
+
+  root->_retired = true;
+  _retired_roots.push_back(root);
+}
+
+/**
+ * Free every retired family of shapes.
+ */
+void shape::free_retired() {
+  for (auto root : _retired_roots) {
+    delete root;
+  }
+
+  _retired_roots.clear();
+}
+
+} // namespace dwt
@@ -0,0 +1,112 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#ifndef GUARD_DWT_SHAPE_HPP
+#define GUARD_DWT_SHAPE_HPP
+
+#include <dwt/hash_map.hpp>
+#include <dwt/var.hpp>
+
+#include <utility>
+#include <vector>
+
+// beyond this many slots further members are kept in a dictionary
+#define SHAPE_MAX_SLOTS 64
+
+namespace dwt {
+
+/**
+ * A shape (or hidden class) describes the layout of an instance by mapping
+ * each member name to an offset in the instance's slot array. Instances
+ * that acquire the same members in the same order share the same shape,
+ * which allows a member lookup to be cached per call site as a simple
+ * (shape, offset) pair.
+ *
+ * Shapes are immutable once created. All shapes derived from a root are
+ * freed together once no class or instance refers to any of them.
+ */
+class shape {
+public:
+  static shape *make_root();
+
+  shape *add(var key);
+  int find(var key) const;
+
+  void acquire();
+  void release();
+
+  bool is_retired() const {
+    return _root->_retired;
+  }
+
+  size_t size() const {
+    return _nr_slots;
+  }
+
+  var key() const {
+    return _key;
+  }
+
+  template <typename Fn> void for_all(Fn f) const {
+    std::vector<const shape *> chain;
+
+    for (auto s = this; s->_parent; s = s->_parent) {
+      chain.push_back(s);
+    }
+
+    while (chain.size() > 0) {
+      f(chain.back()->_key, chain.back()->_nr_slots - 1);
+      chain.pop_back();
+    }
+  }
+
+  template <typename Fn> static void for_all_shapes(Fn f) {
+    for (auto root = _roots; root; root = root->_next) {
+      root->for_all_derived(f);
+    }
+  }
+
+  static bool has_retired() {
+    return _retired_roots.size() > 0;
+  }
+
+  static void free_retired();
+
+private:
+  shape();
+  shape(shape *parent, var key);
+  shape(const shape &) = delete;
+  ~shape();
+
+  template <typename Fn> void for_all_derived(Fn f) {
+    f(this);
+    for (auto &transition : _transitions) {
+      transition.second->for_all_derived(f);
+    }
+  }
+
+  shape *_parent;
+  shape *_root;
+  var _key;
+  size_t _nr_slots;
+  hash_map _offsets;
+  std::vector<std::pair<var, shape *>> _transitions;
+
+  // only maintained by roots
+  shape *_prev;
+  shape *_next;
+  size_t _refs;
+  bool _retired;
+
+  static shape *_roots;
+  static std::vector<shape *> _retired_roots;
+};
+
+} // namespace dwt
+
+#endif
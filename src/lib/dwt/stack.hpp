@@ -86,6 +86,12 @@ public:
     bp[sp] = v;
   }
 
+  // push into space set aside by reserve()
+  inline void push_reserved(T v) {
+    BUG_UNLESS(sp + 1 < space);
+    bp[++sp] = v;
+  }
+
   inline void pop(int n) {
     BUG_UNLESS(sp >= (n - 1));
 
@@ -167,6 +173,20 @@ public:
     return sp + 1;
   }
 
+  inline void truncate(unsigned int n) {
+    sp = n - 1;
+  }
+
+  inline void reserve(unsigned int n) {
+    while (static_cast<int>(n) >= space) {
+      resize();
+    }
+  }
+
+  inline T *base() {
+    return bp;
+  }
+
 private:
   int space;
   int sp;
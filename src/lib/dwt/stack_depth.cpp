@@ -0,0 +1,155 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#include <dwt/opcode.hpp>
+#include <dwt/stack_depth.hpp>
+
+#include <algorithm>
+
+#define OPERAND(op) ((*(op)) | ((*((op) + 1)) << 8))
+
+namespace dwt {
+
+namespace {
+
+struct super_steps {
+  opcode op;
+  opcode steps[3];
+};
+
+const super_steps supers[] = {
+#define SUPER(op, _, __, first, second, third) \
+  { OP_##op, { OP_##first, OP_##second, OP_##third } },
+#include <dwt/superinstructions.inc>
+#undef SUPER
+};
+
+// the deepest a superinstruction takes the stack part way through its steps
+int super_peak(opcode op) {
+  for (auto &super : supers) {
+    if (super.op == op) {
+      int d = 0, peak = 0;
+      for (auto step : super.steps) {
+        d += opcode_stack_effect(step);
+        peak = std::max(peak, d);
+      }
+      return peak;
+    }
+  }
+
+  return std::max(0, opcode_stack_effect(op));
+}
+
+} // namespace
+
+/**
+ * @param code The final code of the function.
+ * @param nr_args The number of values on the stack on entry, the callee
+ * and its arguments.
+ */
+stack_depth::stack_depth(code_obj &code, size_t nr_args)
+  : _code(code.byte_vec())
+  , _depth(_code.size(), -1)
+  , _entry(nr_args)
+  , _max(nr_args) {
+
+  flow(0, _entry);
+
+  while (!_pending.empty()) {
+    size_t pos = _pending.back();
+    _pending.pop_back();
+    step(pos);
+  }
+}
+
+// paths joining with a deeper stack are walked again
+void stack_depth::flow(size_t pos, int depth) {
+  if (pos < _code.size() && depth > _depth[pos]) {
+    _depth[pos] = depth;
+    _pending.push_back(pos);
+  }
+}
+
+void stack_depth::step(size_t pos) {
+  opcode op = _code[pos];
+  uint8_t *args = _code.data() + pos + 1;
+  int d = _depth[pos];
+
+  _max = std::max(_max, d + super_peak(op));
+
+  // the stack effects of opcodes.inc are those the compiler tracks locals
+  // with, ops that take a variable number of values off the stack or that
+  // the compiler only emits where the stack no longer matters differ
+  switch (op) {
+  case OP_RET:
+    return;
+  case OP_LOOP:
+    flow(pos + 1 - OPERAND(args), d);
+    return;
+  case OP_BRA:
+    flow(pos + 1 + OPERAND(args), d);
+    return;
+  case OP_BRZ:
+  case OP_BNZ:
+    flow(pos + 1 + OPERAND(args), --d);
+    break;
+  case OP_BRZ_LT_RK:
+  case OP_BRZ_LTEQ_RK:
+  case OP_BRZ_GT_RK:
+  case OP_BRZ_GTEQ_RK:
+  case OP_BRZ_EQ_RK:
+  case OP_BRZ_NEQ_RK:
+  case OP_BRZ_LT_RR:
+  case OP_BRZ_LTEQ_RR:
+  case OP_BRZ_GT_RR:
+  case OP_BRZ_GTEQ_RR:
+  case OP_BRZ_EQ_RR:
+  case OP_BRZ_NEQ_RR:
+    flow(pos + 1 + OPERAND(args + 4), d);
+    break;
+  case OP_FORLOOP_LT_RK:
+  case OP_FORLOOP_LTEQ_RK:
+  case OP_FORLOOP_GT_RK:
+  case OP_FORLOOP_GTEQ_RK:
+  case OP_FORLOOP_LT_RR:
+  case OP_FORLOOP_LTEQ_RR:
+  case OP_FORLOOP_GT_RR:
+  case OP_FORLOOP_GTEQ_RR:
+    // back to the body, or to the test entering it for anything but numbers
+    flow(pos + 1 - OPERAND(args + 4), d);
+    flow(pos + 1 - OPERAND(args + 4) - 7, d);
+    break;
+  case OP_CALL:
+  case OP_TAILCALL:
+    d -= args[2];
+    break;
+  case OP_INVOKE:
+    d -= args[4];
+    break;
+  case OP_POPN:
+    d -= args[0];
+    break;
+  case OP_SUPER:
+    --d;
+    break;
+  case OP_PAIR:
+    d -= 2;
+    break;
+  case OP_MAP:
+    ++d;
+    break;
+  default:
+    d += opcode_stack_effect(op);
+    break;
+  }
+
+  _max = std::max(_max, d);
+  flow(pos + 1 + opcode_operand_bytes(op), d);
+}
+
+} // namespace dwt
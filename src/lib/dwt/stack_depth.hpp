@@ -0,0 +1,46 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#ifndef GUARD_DWT_STACK_DEPTH_HPP
+#define GUARD_DWT_STACK_DEPTH_HPP
+
+#include <dwt/code_obj.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace dwt {
+
+/**
+ * Follows every path through the final bytecode of a function to find the
+ * most values it pushes on top of its arguments. A frame reserves that
+ * much of the exec stack when it is pushed, so the interpreter's own
+ * pushes need no check.
+ */
+class stack_depth {
+public:
+  stack_depth(code_obj &code, size_t nr_args);
+
+  size_t max() const {
+    return _max - _entry;
+  }
+
+private:
+  void flow(size_t pos, int depth);
+  void step(size_t pos);
+
+  std::vector<uint8_t> &_code;
+  std::vector<int> _depth;
+  std::vector<size_t> _pending;
+  int _entry;
+  int _max;
+};
+
+} // namespace dwt
+
+#endif
@@ -0,0 +1,146 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#include <dwt/superinstruction_pass.hpp>
+
+namespace dwt {
+
+namespace {
+
+struct super_form {
+  opcode super_op;
+  opcode steps[3]; // a pair ends with a SKIP
+};
+
+const std::vector<super_form> forms = {
+#define SUPER(super_op, _, __, first, second, third) \
+  { OP_##super_op, { OP_##first, OP_##second, OP_##third } },
+#include <dwt/superinstructions.inc>
+#undef SUPER
+};
+
+std::vector<uint8_t> steps(const super_form &form) {
+  std::vector<uint8_t> steps;
+
+  for (auto step : form.steps) {
+    if (step != OP_SKIP) {
+      steps.push_back(step);
+    }
+  }
+
+  return steps;
+}
+
+std::vector<ph_pattern> patterns() {
+  std::vector<ph_pattern> patterns;
+
+  for (auto &form : forms) {
+    int extent = 0;
+    for (auto step : steps(form)) {
+      extent += 1 + opcode_operand_bytes(step);
+    }
+    patterns.push_back({ steps(form), extent });
+  }
+
+  return patterns;
+}
+
+// the steps of a superinstruction that may raise an error
+bool raises(opcode op) {
+  switch (op) {
+  case OP_GET:
+  case OP_SET:
+  case OP_POP:
+  case OP_NIL:
+  case OP_TRUE:
+  case OP_FALSE:
+  case OP_ZERO:
+  case OP_ONE:
+  case OP_TWO:
+  case OP_CONST:
+  case OP_GLOBAL:
+  case OP_STORE:
+  case OP_MOVE:
+    return false;
+  default:
+    return true;
+  }
+}
+
+} // namespace
+
+/**
+ * Fuse the opcode sequences listed in superinstructions.inc into single
+ * superinstructions. The table is generated from opcode profiles of
+ * training runs by tools/superinstructions.py.
+ *
+ * @param code The code object to optimise.
+ */
+superinstruction_pass::superinstruction_pass(code_obj &code)
+  : peephole(patterns())
+  , _code(code) {
+
+  (*this)(code);
+}
+
+superinstruction_pass::~superinstruction_pass() {
+}
+
+void superinstruction_pass::peep(uint8_t *op, size_t extent) {
+  size_t off = op - _code.entry();
+
+  // forms are tried in table order since the match that triggered this may
+  // also be the start of an earlier form that a jump ruled out elsewhere
+  for (auto &form : forms) {
+    std::vector<size_t> at;
+    size_t pos = 0;
+
+    for (auto step : steps(form)) {
+      while (pos < extent && op[pos] == OP_SKIP) {
+        ++pos;
+      }
+      if (pos >= extent || op[pos] != step) {
+        break;
+      }
+      at.push_back(pos);
+      pos += 1 + opcode_operand_bytes(step);
+    }
+
+    if (at.size() != steps(form).size() || pos > extent ||
+        jumps_into_range(_code, off, pos)) {
+      continue;
+    }
+
+    // errors raised by any step map to the token of the step that raises
+    for (auto step_pos : at) {
+      if (raises(op[step_pos])) {
+        _code.token_at(off, _code.token_at(off + step_pos));
+      }
+    }
+
+    size_t dst = 1;
+    for (auto step_pos : at) {
+      int operand_bytes = opcode_operand_bytes(op[step_pos]);
+      for (int i = 1; i <= operand_bytes; ++i) {
+        op[dst++] = op[step_pos + i];
+      }
+    }
+
+    op[0] = form.super_op;
+    while (dst < pos) {
+      op[dst++] = OP_SKIP;
+    }
+    return;
+  }
+}
+
+bool superinstruction_pass::spans_skips() const {
+  return true;
+}
+
+} // namespace dwt
@@ -15,7 +15,7 @@
 namespace dwt {
 
 tco_pass::tco_pass(code_obj &code)
-  : peephole({ { { OP_CALL, OP_RET }, 3 } })
+  : peephole({ { { OP_CALL, OP_RET }, 5 } })
   , _code(code) {
 
   (*this)(code);
@@ -43,7 +43,7 @@ void tco_pass::peep(uint8_t *op, size_t extent) {
 #undef OP
   };
 
-  int nr_args = op[1];
+  int nr_args = op[3];
   int sp = nr_args + 1;
   uint8_t *ip = op;
 
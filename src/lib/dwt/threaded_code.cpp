@@ -0,0 +1,114 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#include <dwt/constants.hpp>
+#include <dwt/opcode.hpp>
+#include <dwt/threaded_code.hpp>
+
+namespace dwt {
+
+void *const *threaded_code::_handlers = nullptr;
+
+#if THREADING_ENABLED
+
+namespace {
+
+// offset of the constant index within the operands of an op, or -1
+int const_operand(opcode op) {
+  switch (op) {
+  case OP_INVOKE:
+  case OP_MBRGET:
+  case OP_MBRSET:
+  case OP_CONST:
+    return 0;
+  case OP_ADD_RK:
+  case OP_SUB_RK:
+  case OP_BRZ_LT_RK:
+  case OP_BRZ_LTEQ_RK:
+  case OP_BRZ_GT_RK:
+  case OP_BRZ_GTEQ_RK:
+  case OP_BRZ_EQ_RK:
+  case OP_BRZ_NEQ_RK:
+  case OP_FORLOOP_LT_RK:
+  case OP_FORLOOP_LTEQ_RK:
+  case OP_FORLOOP_GT_RK:
+  case OP_FORLOOP_GTEQ_RK:
+    return 2;
+  default:
+    return -1;
+  }
+}
+
+struct super_steps {
+  opcode op;
+  opcode steps[3];
+};
+
+const super_steps supers[] = {
+#define SUPER(op, _, __, first, second, third) \
+  { OP_##op, { OP_##first, OP_##second, OP_##third } },
+#include <dwt/superinstructions.inc>
+#undef SUPER
+};
+
+} // namespace
+
+void threaded_code::thread(code_obj &code) {
+  auto &bytes = code.byte_vec();
+  auto &units = code.threaded();
+  auto &consts = constants::table();
+
+  units.resize(bytes.size());
+
+  for (size_t pos = 0; pos < bytes.size();) {
+    opcode op = bytes[pos];
+    size_t nr_bytes = opcode_operand_bytes(op);
+
+    units[pos] = reinterpret_cast<uintptr_t>(_handlers[op]);
+
+    // every operand byte also holds the 16 bit operand starting there, so
+    // byte and 16 bit operands are both read from a single word
+    for (size_t i = 1; i <= nr_bytes; ++i) {
+      units[pos + i] = bytes[pos + i];
+      if (i < nr_bytes) {
+        units[pos + i] |= bytes[pos + i + 1] << 8;
+      }
+    }
+
+    auto resolve = [&](opcode step, size_t at) {
+      int off = const_operand(step);
+      if (off >= 0) {
+        units[at + off] = consts.get_r(units[at + off]);
+      }
+    };
+
+    resolve(op, pos + 1);
+
+    for (auto &super : supers) {
+      if (super.op == op) {
+        size_t at = pos + 1;
+        for (auto step : super.steps) {
+          resolve(step, at);
+          at += opcode_operand_bytes(step);
+        }
+        break;
+      }
+    }
+
+    pos += 1 + nr_bytes;
+  }
+}
+
+#else
+
+void threaded_code::thread(code_obj &code) {
+}
+
+#endif
+
+} // namespace dwt
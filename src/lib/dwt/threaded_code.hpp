@@ -0,0 +1,68 @@
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// SPDX-License-Identifier: MPL-2.0
+//
+// Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+
+#ifndef GUARD_DWT_THREADED_CODE_HPP
+#define GUARD_DWT_THREADED_CODE_HPP
+
+// handler addresses only exist with computed goto, and the opcode profile
+// needs to see the opcodes themselves
+#if USE_DIRECT_THREADING && USE_COMPUTED_GOTO && !USE_OPCODE_PROFILE
+#define THREADING_ENABLED 1
+#else
+#define THREADING_ENABLED 0
+#endif
+
+#include <dwt/function_obj.hpp>
+
+#include <cstdint>
+
+namespace dwt {
+
+#if THREADING_ENABLED
+typedef uint64_t code_unit;
+#else
+typedef uint8_t code_unit;
+#endif
+
+/**
+ * Functions are run from a pre-decoded copy of their bytecode made on the
+ * first call. Each byte becomes a word: an opcode is replaced by the address
+ * of its handler, a 16 bit operand is widened into the word of its first
+ * byte and a constant operand is replaced by the constant itself. Offsets
+ * are the same in both forms, so jumps and the tokens of errors need no
+ * translation. Without THREADING_ENABLED the bytecode is run as it is.
+ */
+class threaded_code {
+public:
+  static void handlers(void *const *handlers) {
+    _handlers = handlers;
+  }
+
+  static inline code_unit *entry(function_obj *fn) {
+#if THREADING_ENABLED
+    auto &units = fn->code().threaded();
+
+    if (unlikely(units.empty())) {
+      thread(fn->code());
+    }
+
+    return &units[0];
+#else
+    return fn->code().entry();
+#endif
+  }
+
+private:
+  static void thread(code_obj &code);
+
+  static void *const *_handlers;
+};
+
+} // namespace dwt
+
+#endif
@@ -48,6 +48,10 @@ public:
     return lstr;
   }
 
+  token_ref from() const {
+    return token_ref(_seq, _from);
+  }
+
   int line() const {
     return from_line();
   }
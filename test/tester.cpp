@@ -21,6 +21,8 @@
 #include <thread>
 #include <vector>
 
+#include <sys/wait.h>
+
 namespace fs = std::filesystem;
 
 struct test_cfg {
@@ -30,6 +32,7 @@ struct test_cfg {
   std::string command = "dwt";
   bool skip = false;
   int loops = 1;
+  int exitcode = 0;
 };
 
 struct kv_pair {
@@ -179,6 +182,15 @@ void get_loops(test_cfg &test, std::vector<kv_pair> &kv_pairs) {
   }
 }
 
+void get_exitcode(test_cfg &test, std::vector<kv_pair> &kv_pairs) {
+  for (auto &kvp : kv_pairs) {
+    if (kvp.key == "exitcode") {
+      test.exitcode = atoi(kvp.value.c_str());
+      break;
+    }
+  }
+}
+
 std::shared_ptr<test_cfg> parse_test(fs::path &cfg) {
   auto test = std::make_shared<test_cfg>();
   auto pairs = parse_kv_pairs(cfg);
@@ -189,6 +201,7 @@ std::shared_ptr<test_cfg> parse_test(fs::path &cfg) {
   get_command(*test, pairs);
   get_skip(*test, pairs);
   get_loops(*test, pairs);
+  get_exitcode(*test, pairs);
 
   if (test->skip == false) {
     total_iterations += test->loops;
@@ -309,17 +322,19 @@ void run_test(test_cfg test) {
     auto elapsed =
       std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
 
-    if (status != 0) {
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != test.exitcode) {
       log_test(test, TEST_FAILED, elapsed.count());
       break;
     }
 
+    // a test expected to fail checks what was printed before the error too
     if (fs::exists(test_base + ".err")) {
       if (!files_match(test_base + ".err", err_file)) {
         log_test(test, TEST_FAILED, elapsed.count());
         break;
       }
-    } else if (fs::exists(test_base + ".out")) {
+    }
+    if (fs::exists(test_base + ".out")) {
       if (!files_match(test_base + ".out", out_file)) {
         log_test(test, TEST_FAILED, elapsed.count());
         break;
@@ -434,6 +449,7 @@ void generate_fuzz_test(test_cfg &test, unsigned int fuzz_tc_num) {
   ofs.open(std::string(fuzz_base + ".cfg").c_str());
   ofs << "name: " << fuzz_tc_name.c_str() << "\n";
   ofs << "command: " << test.command.c_str() << "\n";
+  ofs << "exitcode: " << test.exitcode << "\n";
 
   std::string fuzzer_cmd =
     "./fuzzer " + orig_base + ".dwt" + " > " + fuzz_base + ".dwt";
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# SPDX-License-Identifier: MPL-2.0
+#
+# Copyright (C) 2020-2021 Andrew Scott-Jones and Contributors
+#
+# Generate src/lib/dwt/superinstructions.inc from opcode profiles.
+#
+# Build with USE_OPCODE_PROFILE=1 and USE_SUPERINSTRUCTIONS=0, run the
+# training workloads (each run appends to opcode.profile, or the file named
+# by DWT_OPCODE_PROFILE), then:
+#
+#   tools/superinstructions.py opcode.profile [more.profile ...]
+#
+# The opcode pairs and triples saving the most dispatches become
+# superinstructions. Their handlers, the peephole pass that emits them, the
+# decompiler and the JIT are all expanded from the generated table.
+
+import argparse
+import collections
+import os
+import re
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+OPCODES = os.path.join(ROOT, 'src/lib/dwt/opcodes.inc')
+TABLE = os.path.join(ROOT, 'src/lib/dwt/superinstructions.inc')
+
+# opcodes that a superinstruction may be built from, each has a STEP_ macro
+# in interpreter.cpp and a template in the JIT
+FUSABLE = {
+    'GET', 'SET', 'POP', 'NIL', 'TRUE', 'FALSE', 'ZERO', 'ONE', 'TWO',
+    'CONST', 'GLOBAL', 'STORE', 'MOVE',
+    'ADD', 'SUB', 'MUL', 'DIV', 'INC', 'DEC', 'NEG',
+    'LT', 'LTEQ', 'GT', 'GTEQ', 'EQ', 'NEQ',
+    'ADD_RR', 'SUB_RR', 'MUL_RR', 'DIV_RR', 'LT_RR', 'LTEQ_RR', 'GT_RR',
+    'GTEQ_RR', 'EQ_RR', 'NEQ_RR',
+    'ADD_RRR', 'SUB_RRR', 'MUL_RRR', 'DIV_RRR',
+    'ADD_RK', 'SUB_RK', 'INC_R', 'DEC_R',
+}
+
+# errors raised inside a superinstruction are reported at a single token, so
+# at most one of its steps may raise one
+RAISES = FUSABLE - {
+    'GET', 'SET', 'POP', 'NIL', 'TRUE', 'FALSE', 'ZERO', 'ONE', 'TWO',
+    'CONST', 'GLOBAL', 'STORE', 'MOVE',
+}
+
+# quickened opcodes are rewritten in place at run time, the compiler only
+# ever emits their generic form
+QUICKENED = re.compile(r'^(\w+)_(NUM|STR)$')
+
+
+def read_opcodes():
+    ops = {}
+    with open(OPCODES) as f:
+        for m in re.finditer(r'^OP\((\w+), (-?\d+), (\d+)\)', f.read(), re.M):
+            ops[m.group(1)] = (int(m.group(2)), int(m.group(3)))
+    return ops
+
+
+def generic(op):
+    m = QUICKENED.match(op)
+    return m.group(1) if m else op
+
+
+def read_profiles(paths):
+    counts = collections.Counter()
+    for path in paths:
+        with open(path) as f:
+            for line in f:
+                count, *ops = line.split()
+                ops = tuple(generic(op) for op in ops)
+                counts[ops] += int(count)
+                counts[ops[1:]] += int(count)
+    return counts
+
+
+def fusable(seq, ops):
+    return (all(op in FUSABLE for op in seq) and
+            sum(op in RAISES for op in seq) <= 1 and
+            sum(ops[op][1] for op in seq) <= 255)
+
+
+def contains(seq, sub):
+    return any(seq[i:i + len(sub)] == sub
+               for i in range(len(seq) - len(sub) + 1))
+
+
+def choose(counts, ops, n):
+    """Greedily pick the sequences saving the most dispatches. Once a
+    sequence is picked, the dispatches of the shorter sequences inside it
+    are already saved, so its count is taken off theirs."""
+    remaining = {seq: count for seq, count in counts.items()
+                 if len(seq) > 1 and fusable(seq, ops)}
+    chosen = []
+
+    while remaining and len(chosen) < n:
+        seq = max(remaining,
+                  key=lambda seq: (remaining[seq] * (len(seq) - 1), seq))
+        count = remaining.pop(seq)
+        if count == 0:
+            break
+        chosen.append((seq, count))
+
+        for other in remaining:
+            if contains(seq, other):
+                remaining[other] = max(0, remaining[other] - count)
+
+    return chosen
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('profiles', nargs='+')
+    parser.add_argument('-n', '--count', type=int, default=16,
+                        help='number of superinstructions to generate')
+    parser.add_argument('-o', '--output', default=TABLE)
+    args = parser.parse_args()
+
+    ops = read_opcodes()
+    chosen = choose(read_profiles(args.profiles), ops, args.count)
+
+    if len(ops) + len(chosen) > 256:
+        sys.exit('too many opcodes')
+
+    with open(args.output, 'w') as out:
+        out.write('// Generated by tools/superinstructions.py, do not edit.\n')
+        out.write('//\n')
+        out.write('// format: SUPER(<opcode>, <stack effect>, '
+                  '<operand bytes>,\n')
+        out.write('//               <first>, <second>, <third>)\n')
+        out.write('//\n')
+        out.write('// A pair has SKIP as its third opcode. Ordered by the '
+                  'number of dispatches\n')
+        out.write('// saved in the training runs, the optimiser tries them '
+                  'in this order.\n\n')
+
+        for seq, count in chosen:
+            effect = sum(ops[op][0] for op in seq)
+            operand_bytes = sum(ops[op][1] for op in seq)
+            steps = list(seq) + ['SKIP'] * (3 - len(seq))
+            out.write('SUPER(%s, %d, %d, %s) // %d\n' %
+                      ('_'.join(seq), effect, operand_bytes,
+                       ', '.join(steps), count))
+
+
+if __name__ == '__main__':
+    main()